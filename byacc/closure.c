@@ -156,12 +156,74 @@ closure(byacc_t* S, Value_t *nucleus, int n)
 #endif
 }
 
+/*
+ * When a report will walk the states again (the -g graph), the closure of
+ * each state is kept as lr0 computes it, rather than being recomputed.
+ * The closures are packed one after another in fs1_closure_items, and
+ * state i's closure starts at fs1_closure_start[i].
+ */
+void
+keep_closure(byacc_t* S)
+{
+    int n = (int)(S->itemsetend - S->itemset);
+
+    if (!S->fs1_keep_closures)
+	return;
+
+    if (S->fs1_nclosures + 1 >= S->fs1_maxclosures)
+    {
+	S->fs1_maxclosures = 2 * S->fs1_maxclosures + 64;
+	S->fs1_closure_start = TREALLOC(int, S->fs1_closure_start,
+					 S->fs1_maxclosures);
+	NO_SPACE(S->fs1_closure_start);
+	S->fs1_closure_start[0] = 0;
+    }
+    if (S->fs1_closure_used + n > S->fs1_closure_size)
+    {
+	S->fs1_closure_size = 2 * S->fs1_closure_size + n + 1024;
+	S->fs1_closure_items = TREALLOC(Value_t, S->fs1_closure_items,
+					 S->fs1_closure_size);
+	NO_SPACE(S->fs1_closure_items);
+    }
+
+    memcpy(S->fs1_closure_items + S->fs1_closure_used, S->itemset,
+	   (size_t)n * sizeof(Value_t));
+    S->fs1_closure_used += n;
+    S->fs1_closure_start[++S->fs1_nclosures] = S->fs1_closure_used;
+}
+
+/*
+ * Set itemset to the closure of a numbered state, from the kept closures
+ * if there are any.
+ */
+void
+state_closure(byacc_t* S, int stateno)
+{
+    if (stateno < S->fs1_nclosures)
+    {
+	int first = S->fs1_closure_start[stateno];
+	int n = S->fs1_closure_start[stateno + 1] - first;
+
+	memcpy(S->itemset, S->fs1_closure_items + first,
+	       (size_t)n * sizeof(Value_t));
+	S->itemsetend = S->itemset + n;
+    }
+    else
+    {
+	closure(S, S->state_table[stateno]->items,
+		S->state_table[stateno]->nitems);
+    }
+}
+
 void
 finalize_closure(byacc_t* S)
 {
     FREE(S->itemset);
     FREE(S->ruleset);
     FREE(S->fs1_first_derives);
+    DO_FREE(S->fs1_closure_start);
+    DO_FREE(S->fs1_closure_items);
+    S->fs1_nclosures = 0;
 }
 
 #ifdef	DEBUG
@@ -260,12 +260,23 @@ struct core
 {
     struct core *next;
     struct core *link;
+    unsigned hash;
     Value_t number;
     Value_t accessing_symbol;
     Value_t nitems;
     Value_t items[1];
 };
 
+/*  the blocks from which the cores are allocated  */
+
+typedef struct core_block core_block;
+struct core_block
+{
+    struct core_block *next;
+    size_t used;
+    size_t size;
+};
+
 /*  the structure used to record shifts  */
 
 typedef struct shifts shifts;
@@ -313,12 +324,17 @@ struct param
 };
 
 /*From lalr.c*/
-typedef struct shorts
+/*  a relation over gotos (or lookaheads), in compressed sparse row form:  */
+/*  the edges from i are edge[start[i]] .. edge[start[i + 1] - 1]		*/
+typedef struct relation
 {
-    struct shorts *next;
-    Value_t value;
+    int *start;
+    Value_t *edge;
 }
-shorts;
+relation;
+
+/*From warshall.c*/
+typedef void (*bitset_or_t) (bitword_t *dst, const bitword_t *src, int n);
 
 /* reader.c */
 
@@ -361,6 +377,7 @@ typedef struct byacc_t {
     char unicc_flag;
     char carburetta_flag;
     char sql_flag;
+    char tight_flag;
     const char *symbol_prefix;
 
     const char *myname;
@@ -462,6 +479,7 @@ typedef struct byacc_t {
 
     Value_t nstates;
     core *first_state;
+    core_block *core_blocks;
     shifts *first_shift;
     reductions *first_reduction;
     Value_t *accessing_symbol;
@@ -498,6 +516,13 @@ typedef struct byacc_t {
     bitword_t *fs1_first_base;
     bitword_t *fs1_first_derives;
     bitword_t *fs1_EFF;
+    char fs1_keep_closures;
+    int fs1_nclosures;
+    int fs1_maxclosures;
+    int *fs1_closure_start;
+    Value_t *fs1_closure_items;
+    int fs1_closure_used;
+    int fs1_closure_size;
 
     /*From graph.c*/
     unsigned int fs2_larno;
@@ -508,15 +533,17 @@ typedef struct byacc_t {
     int fs3_maxrhs;
     Value_t fs3_ngotos;
     bitword_t *fs3_F;
-    Value_t **fs3_includes;
-    shorts **fs3_lookback;
-    Value_t **fs3_R;
+    relation fs3_includes;
+    relation fs3_lookback;
+    relation *fs3_R;
     Value_t *fs3_INDEX;
     Value_t *fs3_VERTICES;
     Value_t fs3_top;
+    bitset_or_t fs3_set_or;
 
     /*From lro.c*/
     core **fs4_state_set;
+    unsigned fs4_state_mask;
     core *fs4_this_state;
     core *fs4_last_state;
     shifts *fs4_last_shift;
@@ -562,7 +589,6 @@ typedef struct byacc_t {
     Value_t *state_count;
     Value_t *order;
     Value_t *base;
-    Value_t *pos;
     int maxtable;
     Value_t *table;
     Value_t *check;
@@ -661,6 +687,8 @@ extern const char *ygv_line_format;
 
 /* closure.c */
 extern void closure(byacc_t* S, Value_t *nucleus, int n);
+extern void keep_closure(byacc_t* S);
+extern void state_closure(byacc_t* S, int stateno);
 extern void finalize_closure(byacc_t* S);
 extern void set_first_derives(byacc_t* S);
 
@@ -783,6 +811,7 @@ extern void free_symbols(byacc_t* S);
 extern void verbose(byacc_t* S);
 
 /* warshall.c */
+extern bitset_or_t bitset_or_kernel(int n);
 extern void reflexive_transitive_closure(bitword_t *R, int n);
 
 #ifdef DEBUG
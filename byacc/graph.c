@@ -19,7 +19,7 @@ graph(byacc_t* S)
 
     for (i = 0; i < S->nstates; ++i)
     {
-	closure(S, S->state_table[i]->items, S->state_table[i]->nitems);
+	state_closure(S, i);
 	graph_state(S, i);
     }
 
@@ -2,20 +2,25 @@
 
 #include "defs.h"
 
-//typedef struct shorts
-//{
-//    struct shorts *next;
-//    Value_t value;
-//}
-//shorts;
+/*  one goto on the explicit stack used by traverse()  */
+typedef struct visit
+{
+    Value_t vertex;
+    Value_t height;
+    int next;
+}
+visit;
 
 static Value_t map_goto(byacc_t* S, int state, int symbol);
-static Value_t **transpose(byacc_t* S, Value_t **R, int n);
-static void add_lookback_edge(byacc_t* S, int stateno, int ruleno, int gotono);
+static void transpose(byacc_t* S, relation *T, const relation *R, int n, int m);
+static void append_edge(byacc_t* S, relation *R, int *maxedges, int nedges,
+			int value);
+static void add_lookback_edge(byacc_t* S, relation *R, int *maxedges,
+			      int nedges, int stateno, int ruleno);
 static void build_relations(byacc_t* S);
 static void compute_FOLLOWS(byacc_t* S);
 static void compute_lookaheads(byacc_t* S);
-static void digraph(byacc_t* S, Value_t **relation);
+static void digraph(byacc_t* S, relation *R);
 static void initialize_F(byacc_t* S);
 static void initialize_LA(byacc_t* S);
 static void set_accessing_symbol(byacc_t* S);
@@ -24,12 +29,15 @@ static void set_maxrhs(byacc_t* S);
 static void set_reduction_table(byacc_t* S);
 static void set_shift_table(byacc_t* S);
 static void set_state_table(byacc_t* S);
-static void traverse(byacc_t* S, int i);
+static void push_visit(byacc_t* S, visit *vp, int i);
+static void set_or(byacc_t* S, bitword_t *dst, const bitword_t *src);
+static void traverse(byacc_t* S, int i, visit *stack);
 
 void
 lalr(byacc_t* S)
 {
     S->fs3_tokensetsize = WORDSIZE(S->ntokens);
+    S->fs3_set_or = bitset_or_kernel(S->fs3_tokensetsize);
 
     set_state_table(S);
     set_accessing_symbol(S);
@@ -132,7 +140,6 @@ initialize_LA(byacc_t* S)
 
     S->LA = NEW2(k * S->fs3_tokensetsize, bitword_t);
     S->LAruleno = NEW2(k, Value_t);
-    S->fs3_lookback = NEW2(k, shorts *);
 
     k = 0;
     for (i = 0; i < S->nstates; i++)
@@ -253,26 +260,27 @@ initialize_F(byacc_t* S)
     int j;
     int k;
     shifts *sp;
-    Value_t *edge;
     bitword_t *rowp;
-    Value_t *rp;
-    Value_t **reads;
+    relation reads;
     int nedges;
+    int maxedges;
     int symbol;
     int nwords;
 
     nwords = S->fs3_ngotos * S->fs3_tokensetsize;
     S->fs3_F = NEW2(nwords, bitword_t);
 
-    reads = NEW2(S->fs3_ngotos, Value_t *);
-    edge = NEW2(S->fs3_ngotos + 1, Value_t);
+    reads.start = NEW2(S->fs3_ngotos + 1, int);
+    reads.edge = 0;
     nedges = 0;
+    maxedges = 0;
 
     rowp = S->fs3_F;
     for (i = 0; i < S->fs3_ngotos; i++)
     {
 	int stateno = S->to_state[i];
 
+	reads.start[i] = nedges;
 	sp = S->shift_table[stateno];
 
 	if (sp)
@@ -291,35 +299,21 @@ initialize_F(byacc_t* S)
 	    {
 		symbol = S->accessing_symbol[sp->shift[j]];
 		if (S->nullable[symbol])
-		    edge[nedges++] = map_goto(S, stateno, symbol);
-	    }
-
-	    if (nedges)
-	    {
-		reads[i] = rp = NEW2(nedges + 1, Value_t);
-
-		for (j = 0; j < nedges; j++)
-		    rp[j] = edge[j];
-
-		rp[nedges] = -1;
-		nedges = 0;
+		    append_edge(S, &reads, &maxedges, nedges++,
+				map_goto(S, stateno, symbol));
 	    }
 	}
 
 	rowp += S->fs3_tokensetsize;
     }
+    reads.start[S->fs3_ngotos] = nedges;
 
     SETBIT(S->fs3_F, 0);
-    digraph(S, reads);
-
-    for (i = 0; i < S->fs3_ngotos; i++)
-    {
-	if (reads[i])
-	    FREE(reads[i]);
-    }
+    digraph(S, &reads);
 
-    FREE(reads);
-    FREE(edge);
+    FREE(reads.start);
+    if (reads.edge)
+	FREE(reads.edge);
 }
 
 static void
@@ -335,21 +329,39 @@ build_relations(byacc_t* S)
     int done_flag;
     Value_t stateno;
     int symbol2;
-    Value_t *shortp;
-    Value_t *edge;
     Value_t *states;
-    Value_t **new_includes;
+    relation includes;
+    relation lookback;
+    int nincludes;
+    int maxincludes;
+    int nlookback;
+    int maxlookback;
+
+    /*
+     * Both relations are collected keyed by goto, in goto order, and then
+     * transposed: includes into the reverse relation which digraph() walks,
+     * and lookback into one keyed by lookahead set.
+     */
+    includes.start = NEW2(S->fs3_ngotos + 1, int);
+    includes.edge = 0;
+    nincludes = 0;
+    maxincludes = 0;
+
+    lookback.start = NEW2(S->fs3_ngotos + 1, int);
+    lookback.edge = 0;
+    nlookback = 0;
+    maxlookback = 0;
 
-    S->fs3_includes = NEW2(S->fs3_ngotos, Value_t *);
-    edge = NEW2(S->fs3_ngotos + 1, Value_t);
     states = NEW2(S->fs3_maxrhs + 1, Value_t);
 
     for (i = 0; i < S->fs3_ngotos; i++)
     {
-	int nedges = 0;
 	int symbol1 = S->accessing_symbol[S->to_state[i]];
 	Value_t state1 = S->from_state[i];
 
+	includes.start[i] = nincludes;
+	lookback.start[i] = nlookback;
+
 	for (rulep = S->derives[symbol1]; *rulep >= 0; rulep++)
 	{
 	    length = 1;
@@ -372,7 +384,8 @@ build_relations(byacc_t* S)
 		states[length++] = stateno;
 	    }
 
-	    add_lookback_edge(S, stateno, *rulep, i);
+	    add_lookback_edge(S, &lookback, &maxlookback, nlookback++,
+			      stateno, *rulep);
 
 	    length--;
 	    done_flag = 0;
@@ -383,42 +396,50 @@ build_relations(byacc_t* S)
 		if (ISVAR(*rp))
 		{
 		    stateno = states[--length];
-		    edge[nedges++] = map_goto(S, stateno, *rp);
+		    append_edge(S, &includes, &maxincludes, nincludes++,
+				map_goto(S, stateno, *rp));
 		    if (S->nullable[*rp] && length > 0)
 			done_flag = 0;
 		}
 	    }
 	}
-
-	if (nedges)
-	{
-	    S->fs3_includes[i] = shortp = NEW2(nedges + 1, Value_t);
-	    for (j = 0; j < nedges; j++)
-		shortp[j] = edge[j];
-	    shortp[nedges] = -1;
-	}
     }
+    includes.start[S->fs3_ngotos] = nincludes;
+    lookback.start[S->fs3_ngotos] = nlookback;
+
+    transpose(S, &S->fs3_includes, &includes, S->fs3_ngotos, S->fs3_ngotos);
+    transpose(S, &S->fs3_lookback, &lookback, S->fs3_ngotos,
+	      S->lookaheads[S->nstates]);
+
+    FREE(includes.start);
+    if (includes.edge)
+	FREE(includes.edge);
+    FREE(lookback.start);
+    if (lookback.edge)
+	FREE(lookback.edge);
+    FREE(states);
+}
 
-    new_includes = transpose(S, S->fs3_includes, S->fs3_ngotos);
-
-    for (i = 0; i < S->fs3_ngotos; i++)
-	if (S->fs3_includes[i])
-	    FREE(S->fs3_includes[i]);
-
-    FREE(S->fs3_includes);
-
-    S->fs3_includes = new_includes;
+/*  Append_edge stores edge number nedges of a relation being built.	*/
 
-    FREE(edge);
-    FREE(states);
+static void
+append_edge(byacc_t* S, relation *R, int *maxedges, int nedges, int value)
+{
+    if (nedges >= *maxedges)
+    {
+	*maxedges = 2 * *maxedges + 64;
+	R->edge = TREALLOC(Value_t, R->edge, *maxedges);
+	NO_SPACE(R->edge);
+    }
+    R->edge[nedges] = (Value_t)value;
 }
 
 static void
-add_lookback_edge(byacc_t* S, int stateno, int ruleno, int gotono)
+add_lookback_edge(byacc_t* S, relation *R, int *maxedges, int nedges,
+		  int stateno, int ruleno)
 {
     int i, k;
     int found;
-    shorts *sp;
 
     i = S->lookaheads[stateno];
     k = S->lookaheads[stateno + 1];
@@ -432,184 +453,183 @@ add_lookback_edge(byacc_t* S, int stateno, int ruleno, int gotono)
     }
     assert(found);
 
-    sp = NEW(shorts);
-    sp->next = S->fs3_lookback[i];
-    sp->value = (Value_t)gotono;
-    S->fs3_lookback[i] = sp;
+    append_edge(S, R, maxedges, nedges, i);
 }
 
-static Value_t **
-transpose(byacc_t* S, Value_t **R2, int n)
+/*  Transpose sets T to the reverse of R, a relation from 0..n-1 to 0..m-1. */
+
+static void
+transpose(byacc_t* S, relation *T, const relation *R, int n, int m)
 {
-    Value_t **new_R;
-    Value_t **temp_R;
-    Value_t *nedges;
-    Value_t *sp;
+    int *next;
+    int nedges;
     int i;
+    int e;
 
-    nedges = NEW2(n, Value_t);
+    nedges = R->start[n];
 
-    for (i = 0; i < n; i++)
-    {
-	sp = R2[i];
-	if (sp)
-	{
-	    while (*sp >= 0)
-		nedges[*sp++]++;
-	}
-    }
-
-    new_R = NEW2(n, Value_t *);
-    temp_R = NEW2(n, Value_t *);
-
-    for (i = 0; i < n; i++)
-    {
-	int k = nedges[i];
-
-	if (k > 0)
-	{
-	    sp = NEW2(k + 1, Value_t);
-	    new_R[i] = sp;
-	    temp_R[i] = sp;
-	    sp[k] = -1;
-	}
-    }
+    T->start = NEW2(m + 1, int);
+    for (e = 0; e < nedges; e++)
+	T->start[R->edge[e] + 1]++;
+    for (i = 0; i < m; i++)
+	T->start[i + 1] += T->start[i];
 
-    FREE(nedges);
+    T->edge = NEW2(nedges, Value_t);
+    next = NEW2(m + 1, int);
+    for (i = 0; i < m; i++)
+	next[i] = T->start[i];
 
     for (i = 0; i < n; i++)
     {
-	sp = R2[i];
-	if (sp)
-	{
-	    while (*sp >= 0)
-		*temp_R[*sp++]++ = (Value_t)i;
-	}
+	for (e = R->start[i]; e < R->start[i + 1]; e++)
+	    T->edge[next[R->edge[e]]++] = (Value_t)i;
     }
 
-    FREE(temp_R);
-
-    return (new_R);
+    FREE(next);
 }
 
 static void
 compute_FOLLOWS(byacc_t* S)
 {
-    digraph(S, S->fs3_includes);
+    digraph(S, &S->fs3_includes);
 }
 
 static void
 compute_lookaheads(byacc_t* S)
 {
     int i, n;
-    bitword_t *fp1, *fp2, *fp3;
-    shorts *sp, *next;
+    int e;
     bitword_t *rowp;
 
     rowp = S->LA;
     n = S->lookaheads[S->nstates];
     for (i = 0; i < n; i++)
     {
-	fp3 = rowp + S->fs3_tokensetsize;
-	for (sp = S->fs3_lookback[i]; sp; sp = sp->next)
+	for (e = S->fs3_lookback.start[i]; e < S->fs3_lookback.start[i + 1]; e++)
 	{
-	    fp1 = rowp;
-	    fp2 = S->fs3_F + S->fs3_tokensetsize * sp->value;
-	    while (fp1 < fp3)
-		*fp1++ |= *fp2++;
+	    set_or(S, rowp,
+		   S->fs3_F + S->fs3_tokensetsize * S->fs3_lookback.edge[e]);
 	}
-	rowp = fp3;
+	rowp += S->fs3_tokensetsize;
     }
 
-    for (i = 0; i < n; i++)
-	for (sp = S->fs3_lookback[i]; sp; sp = next)
-	{
-	    next = sp->next;
-	    FREE(sp);
-	}
-
-    FREE(S->fs3_lookback);
+    FREE(S->fs3_lookback.start);
+    if (S->fs3_lookback.edge)
+	FREE(S->fs3_lookback.edge);
+    S->fs3_lookback.start = 0;
+    S->fs3_lookback.edge = 0;
     FREE(S->fs3_F);
 }
 
 static void
-digraph(byacc_t* S, Value_t **relation)
+digraph(byacc_t* S, relation *R)
 {
     int i;
+    visit *stack;
 
     S->fs3_infinity = (Value_t)(S->fs3_ngotos + 2);
     S->fs3_INDEX = NEW2(S->fs3_ngotos + 1, Value_t);
     S->fs3_VERTICES = NEW2(S->fs3_ngotos + 1, Value_t);
     S->fs3_top = 0;
+    stack = NEW2(S->fs3_ngotos + 1, visit);
 
-    S->fs3_R = relation;
+    S->fs3_R = R;
 
     for (i = 0; i < S->fs3_ngotos; i++)
 	S->fs3_INDEX[i] = 0;
 
     for (i = 0; i < S->fs3_ngotos; i++)
     {
-	if (S->fs3_INDEX[i] == 0 && S->fs3_R[i])
-	    traverse(S, i);
+	if (S->fs3_INDEX[i] == 0 && R->start[i] < R->start[i + 1])
+	    traverse(S, i, stack);
     }
 
     FREE(S->fs3_INDEX);
     FREE(S->fs3_VERTICES);
+    FREE(stack);
 }
 
 static void
-traverse(byacc_t* S, int i)
+set_or(byacc_t* S, bitword_t *dst, const bitword_t *src)
 {
-    bitword_t *fp1;
-    bitword_t *fp2;
-    bitword_t *fp3;
-    int j;
-    Value_t *rp;
+    if (S->fs3_set_or != 0)
+    {
+	S->fs3_set_or(dst, src, S->fs3_tokensetsize);
+    }
+    else
+    {
+	int n;
 
-    Value_t height;
-    bitword_t *base;
+	for (n = 0; n < S->fs3_tokensetsize; n++)
+	    dst[n] |= src[n];
+    }
+}
 
+static void
+push_visit(byacc_t* S, visit *vp, int i)
+{
     S->fs3_VERTICES[++S->fs3_top] = (Value_t)i;
-    S->fs3_INDEX[i] = height = S->fs3_top;
+    S->fs3_INDEX[i] = S->fs3_top;
 
-    base = S->fs3_F + i * S->fs3_tokensetsize;
-    fp3 = base + S->fs3_tokensetsize;
+    vp->vertex = (Value_t)i;
+    vp->height = S->fs3_top;
+    vp->next = S->fs3_R->start[i];
+}
 
-    rp = S->fs3_R[i];
-    if (rp)
+/*
+ * Traverse is the recursive walk of DeRemer and Pennello's digraph, kept on
+ * an explicit stack so that long chains of gotos cannot exhaust the C stack.
+ * An edge to an unvisited goto pushes that goto, and the edge is taken up
+ * again, with the goto's result, once it has been popped.
+ */
+static void
+traverse(byacc_t* S, int i, visit *stack)
+{
+    int depth;
+    int size = S->fs3_tokensetsize;
+
+    push_visit(S, &stack[0], i);
+    depth = 1;
+
+    while (depth > 0)
     {
-	while ((j = *rp++) >= 0)
+	visit *vp = &stack[depth - 1];
+	int k = vp->vertex;
+	int j;
+	bitword_t *base = S->fs3_F + k * size;
+
+	if (vp->next < S->fs3_R->start[k + 1])
 	{
-	    if (S->fs3_INDEX[j] == 0)
-		traverse(S, j);
+	    j = S->fs3_R->edge[vp->next];
 
-	    if (S->fs3_INDEX[i] > S->fs3_INDEX[j])
-		S->fs3_INDEX[i] = S->fs3_INDEX[j];
+	    if (S->fs3_INDEX[j] == 0)
+	    {
+		push_visit(S, &stack[depth++], j);
+		continue;
+	    }
 
-	    fp1 = base;
-	    fp2 = S->fs3_F + j * S->fs3_tokensetsize;
+	    if (S->fs3_INDEX[k] > S->fs3_INDEX[j])
+		S->fs3_INDEX[k] = S->fs3_INDEX[j];
 
-	    while (fp1 < fp3)
-		*fp1++ |= *fp2++;
+	    set_or(S, base, S->fs3_F + j * size);
+	    vp->next++;
+	    continue;
 	}
-    }
 
-    if (S->fs3_INDEX[i] == height)
-    {
-	for (;;)
+	if (S->fs3_INDEX[k] == vp->height)
 	{
-	    j = S->fs3_VERTICES[S->fs3_top--];
-	    S->fs3_INDEX[j] = S->fs3_infinity;
-
-	    if (i == j)
-		break;
+	    for (;;)
+	    {
+		j = S->fs3_VERTICES[S->fs3_top--];
+		S->fs3_INDEX[j] = S->fs3_infinity;
 
-	    fp1 = base;
-	    fp2 = S->fs3_F + j * S->fs3_tokensetsize;
+		if (k == j)
+		    break;
 
-	    while (fp1 < fp3)
-		*fp2++ = *fp1++;
+		memcpy(S->fs3_F + j * size, base, (size_t)size * sizeof(bitword_t));
+	    }
 	}
+	depth--;
     }
 }
 
@@ -617,15 +637,7 @@ traverse(byacc_t* S, int i)
 void
 lalr_leaks(byacc_t* S)
 {
-    if (S->fs3_includes != 0)
-    {
-	int i;
-
-	for (i = 0; i < S->fs3_ngotos; i++)
-	{
-	    free(S->fs3_includes[i]);
-	}
-	DO_FREE(S->fs3_includes);
-    }
+    DO_FREE(S->fs3_includes.start);
+    DO_FREE(S->fs3_includes.edge);
 }
 #endif
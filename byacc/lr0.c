@@ -2,8 +2,11 @@
 
 #include "defs.h"
 
-static core *new_state(byacc_t* S, int symbol);
+static core *new_state(byacc_t* S, int symbol, unsigned hash);
 static Value_t get_state(byacc_t* S, int symbol);
+static void *alloc_core(byacc_t* S, size_t n);
+static unsigned hash_kernel(const Value_t *isp, const Value_t *iend);
+static void grow_state_set(byacc_t* S);
 static void allocate_itemsets(byacc_t* S);
 static void allocate_storage(byacc_t* S);
 static void append_states(byacc_t* S);
@@ -61,10 +64,16 @@ allocate_itemsets(byacc_t* S)
 static void
 allocate_storage(byacc_t* S)
 {
+    unsigned size;
+
     allocate_itemsets(S);
     S->fs4_shiftset = NEW2(S->nsyms, Value_t);
     S->fs4_redset = NEW2(S->nrules + 1, Value_t);
-    S->fs4_state_set = NEW2(S->nitems, core *);
+
+    for (size = 64; size < (unsigned)S->nitems; size *= 2)
+	continue;
+    S->fs4_state_set = NEW2(size, core *);
+    S->fs4_state_mask = size - 1;
 }
 
 static void
@@ -116,10 +125,12 @@ generate_states(byacc_t* S)
     S->ruleset = NEW2(WORDSIZE(S->nrules), bitword_t);
     set_first_derives(S);
     initialize_states(S);
+    S->fs1_keep_closures = S->gflag;
 
     while (S->fs4_this_state)
     {
 	closure(S, S->fs4_this_state->items, S->fs4_this_state->nitems);
+	keep_closure(S);
 	save_reductions(S);
 	new_itemsets(S);
 	append_states(S);
@@ -133,13 +144,27 @@ generate_states(byacc_t* S)
     free_storage(S);
 }
 
+/*
+ * States are found by hashing their whole kernel, so that states which
+ * share a leading item do not pile up on one chain.
+ */
+static unsigned
+hash_kernel(const Value_t *isp, const Value_t *iend)
+{
+    unsigned h = 2166136261U;
+
+    while (isp < iend)
+	h = (h ^ (unsigned)*isp++) * 16777619U;
+    return h;
+}
+
 static Value_t
 get_state(byacc_t* S, int symbol)
 {
-    int key;
     Value_t *isp1;
     Value_t *iend;
     core *sp;
+    unsigned h;
     int n;
 
 #ifdef	TRACE
@@ -149,51 +174,75 @@ get_state(byacc_t* S, int symbol)
     isp1 = S->fs4_kernel_base[symbol];
     iend = S->fs4_kernel_end[symbol];
     n = (int)(iend - isp1);
+    assert(0 <= *isp1 && *isp1 < S->nitems);
 
-    key = *isp1;
-    assert(0 <= key && key < S->nitems);
-    sp = S->fs4_state_set[key];
-    if (sp)
+    h = hash_kernel(isp1, iend);
+    for (sp = S->fs4_state_set[h & S->fs4_state_mask]; sp; sp = sp->link)
     {
-	int found = 0;
+	if (sp->hash == h
+	    && sp->nitems == n
+	    && !memcmp(sp->items, isp1, (size_t)n * sizeof(Value_t)))
+	    return (sp->number);
+    }
 
-	while (!found)
-	{
-	    if (sp->nitems == n)
-	    {
-		Value_t *isp2;
+    sp = new_state(S, symbol, h);
+    sp->link = S->fs4_state_set[h & S->fs4_state_mask];
+    S->fs4_state_set[h & S->fs4_state_mask] = sp;
 
-		found = 1;
-		isp1 = S->fs4_kernel_base[symbol];
-		isp2 = sp->items;
+    if ((unsigned)S->nstates > S->fs4_state_mask)
+	grow_state_set(S);
 
-		while (found && isp1 < iend)
-		{
-		    if (*isp1++ != *isp2++)
-			found = 0;
-		}
-	    }
+    return (sp->number);
+}
 
-	    if (!found)
-	    {
-		if (sp->link)
-		{
-		    sp = sp->link;
-		}
-		else
-		{
-		    sp = sp->link = new_state(S, symbol);
-		    found = 1;
-		}
-	    }
-	}
+/* double the buckets in the state hash table, using the saved hashes */
+static void
+grow_state_set(byacc_t* S)
+{
+    unsigned mask = 2 * S->fs4_state_mask + 1;
+    core **set = NEW2(mask + 1, core *);
+    core *sp;
+
+    /* the initial state is never looked up, so it is not in the table */
+    for (sp = S->first_state->next; sp; sp = sp->next)
+    {
+	sp->link = set[sp->hash & mask];
+	set[sp->hash & mask] = sp;
     }
-    else
+
+    FREE(S->fs4_state_set);
+    S->fs4_state_set = set;
+    S->fs4_state_mask = mask;
+}
+
+/*
+ * Cores are carved out of large blocks, which are freed together once the
+ * state machine is no longer needed.
+ */
+#define CORE_BLOCK_SIZE 65536
+#define CORE_ALIGN(n) (((n) + sizeof(core *) - 1) & ~(sizeof(core *) - 1))
+
+static void *
+alloc_core(byacc_t* S, size_t n)
+{
+    core_block *bp = S->core_blocks;
+    char *p;
+
+    n = CORE_ALIGN(n);
+    if (bp == 0 || bp->used + n > bp->size)
     {
-	S->fs4_state_set[key] = sp = new_state(S, symbol);
+	size_t size = (n > CORE_BLOCK_SIZE) ? n : CORE_BLOCK_SIZE;
+
+	bp = (core_block *)allocate(S, CORE_ALIGN(sizeof(core_block)) + size);
+	bp->size = size;
+	bp->used = 0;
+	bp->next = S->core_blocks;
+	S->core_blocks = bp;
     }
 
-    return (sp->number);
+    p = (char *)bp + CORE_ALIGN(sizeof(core_block)) + bp->used;
+    bp->used += n;
+    return (p);
 }
 
 static void
@@ -207,11 +256,11 @@ initialize_states(byacc_t* S)
     for (i = 0; start_derives[i] >= 0; ++i)
 	continue;
 
-    p = (core *)MALLOC(sizeof(core) + i * sizeof(Value_t));
-    NO_SPACE(p);
+    p = (core *)alloc_core(S, sizeof(core) + i * sizeof(Value_t));
 
     p->next = 0;
     p->link = 0;
+    p->hash = 0;
     p->number = 0;
     p->accessing_symbol = 0;
     p->nitems = (Value_t)i;
@@ -259,7 +308,7 @@ new_itemsets(byacc_t* S)
 }
 
 static core *
-new_state(byacc_t* S, int symbol)
+new_state(byacc_t* S, int symbol, unsigned hash)
 {
     unsigned n;
     core *p;
@@ -278,7 +327,8 @@ new_state(byacc_t* S, int symbol)
     iend = S->fs4_kernel_end[symbol];
     n = (unsigned)(iend - isp1);
 
-    p = (core *)allocate(S, (sizeof(core) + (n - 1) * sizeof(Value_t)));
+    p = (core *)alloc_core(S, (sizeof(core) + (n - 1) * sizeof(Value_t)));
+    p->hash = hash;
     p->accessing_symbol = (Value_t)symbol;
     p->number = (Value_t)S->nstates;
     p->nitems = (Value_t)n;
@@ -211,6 +211,7 @@ usage(byacc_t* S)
 	{ "  -s                    suppress #define's for quoted names in %token lines" },
 	{ "  -S                    write grammar as sql" },
 	{ "  -t                    add debugging support" },
+	{ "  -T                    pack tables harder, and report packing statistics" },
 	{ "  -v                    write description (y.output)" },
 	{ "  -V                    show version information and exit" },
 	{ "  -u                    ignore precedences" },
@@ -328,6 +329,10 @@ setflag(byacc_t* S, int ch)
 	S->tflag = 1;
 	break;
 
+    case 'T':
+	S->tight_flag = 1;
+	break;
+
     case 'v':
 	S->vflag = 1;
 	break;
@@ -410,7 +415,7 @@ getargs(byacc_t* S, int argc, char *argv[])
     if (argc > 0)
 	S->myname = argv[0];
 
-    while ((ch = getopt(argc, argv, "Bb:cCdEeghH:ilLnNo:Pp:rsStVvyuz")) != -1)
+    while ((ch = getopt(argc, argv, "Bb:cCdEeghH:ilLnNo:Pp:rsStTVvyuz")) != -1)
     {
 	switch (ch)
 	{
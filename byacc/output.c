@@ -2,6 +2,8 @@
 
 #include "defs.h"
 
+#include <time.h>
+
 #define StaticOrR	(S->rflag ? "" : "static ")
 #define CountLine(fp)   (!S->rflag || ((fp) == S->code_file))
 
@@ -711,14 +713,64 @@ goto_actions(byacc_t* S)
     FREE(S->state_count);
 }
 
+/*  Vector_before is true if vector a is packed ahead of vector b: wider	*/
+/*  vectors go first, and among equally wide ones those with more entries,	*/
+/*  or with fewer if fewest_first is set.				*/
+
+static int
+vector_before(byacc_t* S, int a, int b, int fewest_first)
+{
+    if (S->width[a] != S->width[b])
+	return (S->width[a] > S->width[b]);
+    if (fewest_first)
+	return (S->tally[a] < S->tally[b]);
+    return (S->tally[a] > S->tally[b]);
+}
+
+/*  Sort_vectors orders order[] for packing.  The merge sort is stable,	*/
+/*  so vectors which tie keep their original order.			*/
+
+static void
+sort_vectors(byacc_t* S, int fewest_first)
+{
+    Value_t *temp;
+    int size;
+
+    temp = NEW2(S->nentries, Value_t);
+    for (size = 1; size < S->nentries; size *= 2)
+    {
+	int lo;
+
+	for (lo = 0; lo + size < S->nentries; lo += 2 * size)
+	{
+	    int mid = lo + size;
+	    int hi = (mid + size < S->nentries) ? mid + size : S->nentries;
+	    int a = lo;
+	    int b = mid;
+	    int k = lo;
+
+	    while (a < mid && b < hi)
+	    {
+		if (vector_before(S, S->order[b], S->order[a], fewest_first))
+		    temp[k++] = S->order[b++];
+		else
+		    temp[k++] = S->order[a++];
+	    }
+	    while (a < mid)
+		temp[k++] = S->order[a++];
+	    while (b < hi)
+		temp[k++] = S->order[b++];
+	    for (k = lo; k < hi; k++)
+		S->order[k] = temp[k];
+	}
+    }
+    FREE(temp);
+}
+
 static void
 sort_actions(byacc_t* S)
 {
-    Value_t i;
-    int j;
-    int k;
-    int t;
-    int w;
+    int i;
 
     S->order = NEW2(S->nvectors, Value_t);
     S->nentries = 0;
@@ -726,24 +778,75 @@ sort_actions(byacc_t* S)
     for (i = 0; i < S->nvectors; i++)
     {
 	if (S->tally[i] > 0)
-	{
-	    t = S->tally[i];
-	    w = S->width[i];
-	    j = S->nentries - 1;
+	    S->order[S->nentries++] = (Value_t)i;
+    }
 
-	    while (j >= 0 && (S->width[S->order[j]] < w))
-		j--;
+    sort_vectors(S, 0);
+}
 
-	    while (j >= 0 && (S->width[S->order[j]] == w) && (S->tally[S->order[j]] < t))
-		j--;
+/*  The packer state which is only needed while pack_table runs: a bitmap	*/
+/*  of the check[] slots in use, a hash set of the bases handed out, and	*/
+/*  hash chains of the vectors packed so far, for matching_vector.	*/
 
-	    for (k = S->nentries - 1; k > j; k--)
-		S->order[k + 1] = S->order[k];
+typedef struct
+{
+    bitword_t *occupied;
+    int noccupied;
+    int *bases;
+    int bases_mask;
+    int *bucket;
+    int *chain;
+    int bucket_mask;
+    int window;
+}
+packer;
 
-	    S->order[j + 1] = i;
-	    S->nentries++;
-	}
+#define NO_BASE INT_MIN
+
+static unsigned
+hash_vector(byacc_t* S, int i)
+{
+    unsigned h = (unsigned)S->tally[i];
+    int k;
+
+    for (k = 0; k < S->tally[i]; k++)
+    {
+	h = h * 31 + (unsigned)S->froms[i][k];
+	h = h * 31 + (unsigned)S->tos[i][k];
     }
+    return h;
+}
+
+static int
+base_used(packer *P, int j)
+{
+    unsigned h = (unsigned)j * 2654435761U;
+    int n;
+
+    for (n = (int)(h & (unsigned)P->bases_mask);
+	 P->bases[n] != NO_BASE;
+	 n = (n + 1) & P->bases_mask)
+    {
+	if (P->bases[n] == j)
+	    return 1;
+    }
+    return 0;
+}
+
+static void
+add_base(packer *P, int j)
+{
+    unsigned h = (unsigned)j * 2654435761U;
+    int n;
+
+    for (n = (int)(h & (unsigned)P->bases_mask);
+	 P->bases[n] != NO_BASE;
+	 n = (n + 1) & P->bases_mask)
+    {
+	if (P->bases[n] == j)
+	    return;
+    }
+    P->bases[n] = j;
 }
 
 /*  The function matching_vector determines if the vector specified by	*/
@@ -758,9 +861,9 @@ sort_actions(byacc_t* S)
 /*  unlikely.  Therefore, to save time, no attempt is made to see if a	*/
 /*  column matches a previously considered vector.			*/
 /*									*/
-/*  Matching_vector is poorly designed.  The test could easily be made	*/
-/*  faster.  Also, it depends on the vectors being in a specific	*/
-/*  order.								*/
+/*  Every vector considered is kept on a hash chain, most recent first,	*/
+/*  so the match found is the closest earlier vector with the same	*/
+/*  entries, whichever part of the table it came from.			*/
 #if defined(YYBTYACC)
 /*									*/
 /*  Not really any point in checking for matching conflicts -- it is    */
@@ -768,57 +871,170 @@ sort_actions(byacc_t* S)
 #endif
 
 static int
-matching_vector(byacc_t* S, int vector)
+matching_vector(byacc_t* S, packer *P, int vector)
 {
     int i;
     int k;
     int t;
-    int w;
     int prev;
+    unsigned h;
 
     i = S->order[vector];
-    if (i >= 2 * S->nstates)
-	return (-1);
-
+    h = hash_vector(S, i);
     t = S->tally[i];
-    w = S->width[i];
 
-    for (prev = vector - 1; prev >= 0; prev--)
+    for (prev = P->bucket[h & (unsigned)P->bucket_mask];
+	 i < 2 * S->nstates && prev >= 0;
+	 prev = P->chain[prev])
     {
 	int j = S->order[prev];
+	int match = (S->width[j] == S->width[i] && S->tally[j] == t);
 
-	if (S->width[j] != w || S->tally[j] != t)
+	for (k = 0; match && k < t; k++)
 	{
-	    return (-1);
+	    if (S->tos[j][k] != S->tos[i][k] || S->froms[j][k] != S->froms[i][k])
+		match = 0;
 	}
-	else
-	{
-	    int match = 1;
 
-	    for (k = 0; match && k < t; k++)
-	    {
-		if (S->tos[j][k] != S->tos[i][k] || S->froms[j][k] != S->froms[i][k])
-		    match = 0;
-	    }
+	if (match)
+	    return (j);
+    }
+
+    P->chain[vector] = P->bucket[h & (unsigned)P->bucket_mask];
+    P->bucket[h & (unsigned)P->bucket_mask] = vector;
+    return (-1);
+}
+
+#define IS_OCCUPIED(P, loc) \
+	((loc) < (P)->noccupied * BITS_PER_WORD && BIT((P)->occupied, loc))
+
+/*  Next_free returns the first slot at or after loc which is not in use.	*/
+
+static int
+next_free(packer *P, int loc)
+{
+    int w = loc / BITS_PER_WORD;
+
+    if (w < P->noccupied)
+    {
+	bitword_t free_bits = ~P->occupied[w] >> (loc % BITS_PER_WORD);
 
-	    if (match)
-		return (j);
+	if (free_bits == 0)
+	{
+	    while (++w < P->noccupied && P->occupied[w] == ~(bitword_t)0)
+		;
+	    loc = w * BITS_PER_WORD;
+	    if (w >= P->noccupied)
+		return loc;
+	    free_bits = ~P->occupied[w];
+	}
+	while (!(free_bits & 1))
+	{
+	    free_bits >>= 1;
+	    ++loc;
 	}
     }
+    return loc;
+}
 
-    return (-1);
+/*  Free_window has bit n set if slot loc + n is not in use.		*/
+
+static bitword_t
+free_window(packer *P, int loc)
+{
+    int w = loc / BITS_PER_WORD;
+    int b = loc % BITS_PER_WORD;
+    bitword_t lo = (w < P->noccupied) ? P->occupied[w] : 0;
+    bitword_t hi = (w + 1 < P->noccupied) ? P->occupied[w + 1] : 0;
+
+    if (b != 0)
+	lo = (lo >> b) | (hi << (BITS_PER_WORD - b));
+    return ~lo;
 }
 
+static void
+grow_table(byacc_t* S, packer *P, int loc)
+{
+    int l;
+    int newmax;
+    int nwords;
+
+    if (loc >= MAXTABLE - 1)
+	fatal(S, "maximum table size exceeded");
+
+    newmax = S->maxtable;
+    do
+    {
+	newmax += 200;
+    }
+    while (newmax <= loc);
+
+    S->table = TREALLOC(Value_t, S->table, newmax);
+    NO_SPACE(S->table);
+
+    S->check = TREALLOC(Value_t, S->check, newmax);
+    NO_SPACE(S->check);
+
+    for (l = S->maxtable; l < newmax; ++l)
+    {
+	S->table[l] = 0;
+	S->check[l] = -1;
+    }
+    S->maxtable = newmax;
+
+    nwords = WORDSIZE(newmax);
+    P->occupied = TREALLOC(bitword_t, P->occupied, nwords);
+    NO_SPACE(P->occupied);
+    for (l = P->noccupied; l < nwords; ++l)
+	P->occupied[l] = 0;
+    P->noccupied = nwords;
+}
+
+/*  Fit_score rates a base at which the vector fits, for better-fit	*/
+/*  packing.  Growing the table counts against a base before anything	*/
+/*  else; after that, entries which land next to slots already in use	*/
+/*  score, as they leave fewer scattered holes.				*/
+
+static long
+fit_score(byacc_t* S, packer *P, int j, const Value_t *from, int t)
+{
+    long score = 0;
+    long top = S->high;
+    int k;
+
+    for (k = 0; k < t; k++)
+    {
+	int loc = j + from[k];
+
+	if (loc > top)
+	    top = loc;
+	if (loc > 0 && IS_OCCUPIED(P, loc - 1))
+	    ++score;
+	if (IS_OCCUPIED(P, loc + 1))
+	    ++score;
+    }
+    return score - (top - S->high) * (2 * t + 1);
+}
+
+/*  Pack_vector finds the lowest base at which every entry of the vector	*/
+/*  lands on a free slot, and which no other vector uses.  Candidate	*/
+/*  bases are tried a word at a time: AND-ing the free-slot bitmap, as	*/
+/*  seen from each entry, leaves a bit set for each base that fits.	*/
+/*  With better fit, the next few bases which also fit are scored and	*/
+/*  the best is taken instead.						*/
+
 static int
-pack_vector(byacc_t* S, int vector)
+pack_vector(byacc_t* S, packer *P, int vector)
 {
-    int i, j, k, l;
+    int i, j, k;
     int t;
+    int lo, hi;
     Value_t loc;
-    int ok;
     Value_t *from;
     Value_t *to;
-    int newmax;
+    int best = 0;
+    long best_score = 0;
+    int nfits = 0;
 
     i = S->order[vector];
     t = S->tally[i];
@@ -827,79 +1043,79 @@ pack_vector(byacc_t* S, int vector)
     from = S->froms[i];
     to = S->tos[i];
 
-    j = S->lowzero - from[0];
+    lo = hi = from[0];
     for (k = 1; k < t; ++k)
-	if (S->lowzero - from[k] > j)
-	    j = S->lowzero - from[k];
-    for (;; ++j)
-    {
-	if (j == 0)
-	    continue;
-	ok = 1;
-	for (k = 0; ok && k < t; k++)
-	{
-	    loc = (Value_t)(j + from[k]);
-	    if (loc >= S->maxtable - 1)
-	    {
-		if (loc >= MAXTABLE - 1)
-		    fatal(S, "maximum table size exceeded");
+    {
+	if (from[k] < lo)
+	    lo = from[k];
+	if (from[k] > hi)
+	    hi = from[k];
+    }
 
-		newmax = S->maxtable;
-		do
-		{
-		    newmax += 200;
-		}
-		while (newmax <= loc);
+    for (j = S->lowzero - lo; nfits == 0 || nfits < P->window; j += BITS_PER_WORD)
+    {
+	bitword_t fits = ~(bitword_t)0;
+	int n;
 
-		S->table = TREALLOC(Value_t, S->table, newmax);
-		NO_SPACE(S->table);
+	for (k = 0; fits != 0 && k < t; k++)
+	    fits &= free_window(P, j + from[k]);
 
-		S->check = TREALLOC(Value_t, S->check, newmax);
-		NO_SPACE(S->check);
+	for (n = 0; fits != 0; n++, fits >>= 1)
+	{
+	    long score;
 
-		for (l = S->maxtable; l < newmax; ++l)
-		{
-		    S->table[l] = 0;
-		    S->check[l] = -1;
-		}
-		S->maxtable = newmax;
+	    if (!(fits & 1) || j + n == 0 || base_used(P, j + n))
+		continue;
+
+	    if (P->window == 0)
+	    {
+		best = j + n;
+		nfits = 1;
+		break;
 	    }
 
-	    if (S->check[loc] != -1)
-		ok = 0;
-	}
-	for (k = 0; ok && k < vector; k++)
-	{
-	    if (S->pos[k] == j)
-		ok = 0;
-	}
-	if (ok)
-	{
-	    for (k = 0; k < t; k++)
+	    score = fit_score(S, P, j + n, from, t);
+	    if (nfits == 0 || score > best_score)
 	    {
-		loc = (Value_t)(j + from[k]);
-		S->table[loc] = to[k];
-		S->check[loc] = from[k];
-		if (loc > S->high)
-		    S->high = loc;
+		best = j + n;
+		best_score = score;
 	    }
+	    if (++nfits >= P->window)
+		break;
+	}
+    }
 
-	    while (S->check[S->lowzero] != -1)
-		++S->lowzero;
+    if (best + hi >= S->maxtable - 1)
+	grow_table(S, P, best + hi);
 
-	    return (j);
-	}
+    for (k = 0; k < t; k++)
+    {
+	loc = (Value_t)(best + from[k]);
+	S->table[loc] = to[k];
+	S->check[loc] = from[k];
+	SETBIT(P->occupied, loc);
+	if (loc > S->high)
+	    S->high = loc;
     }
+
+    S->lowzero = next_free(P, S->lowzero);
+
+    return (best);
 }
 
-static void
-pack_table(byacc_t* S)
+/*  Pack_pass lays out every vector, giving base[], table[] and check[].	*/
+/*  It returns the number of table entries used.			*/
+
+static long
+pack_pass(byacc_t* S, int window)
 {
+    packer P;
+    long nused = 0;
     int i;
+    int size;
     Value_t place;
 
     S->base = NEW2(S->nvectors, Value_t);
-    S->pos = NEW2(S->nentries, Value_t);
 
     S->maxtable = 1000;
     S->table = NEW2(S->maxtable, Value_t);
@@ -911,19 +1127,140 @@ pack_table(byacc_t* S)
     for (i = 0; i < S->maxtable; i++)
 	S->check[i] = -1;
 
+    P.noccupied = WORDSIZE(S->maxtable);
+    P.occupied = NEW2(P.noccupied, bitword_t);
+    P.window = window;
+
+    for (size = 16; size < 2 * S->nentries; size *= 2)
+	;
+    P.bases = NEW2(size, int);
+    for (i = 0; i < size; i++)
+	P.bases[i] = NO_BASE;
+    P.bases_mask = size - 1;
+
+    P.bucket = NEW2(size, int);
+    for (i = 0; i < size; i++)
+	P.bucket[i] = -1;
+    P.chain = NEW2(S->nentries, int);
+    P.bucket_mask = size - 1;
+
     for (i = 0; i < S->nentries; i++)
     {
-	int state = matching_vector(S, i);
+	int state = matching_vector(S, &P, i);
 
 	if (state < 0)
-	    place = (Value_t)pack_vector(S, i);
+	{
+	    place = (Value_t)pack_vector(S, &P, i);
+	    nused += S->tally[S->order[i]];
+	}
 	else
 	    place = S->base[state];
 
-	S->pos[i] = place;
+	add_base(&P, place);
 	S->base[S->order[i]] = place;
     }
 
+    FREE(P.occupied);
+    FREE(P.bases);
+    FREE(P.bucket);
+    FREE(P.chain);
+
+    return nused;
+}
+
+static void
+report_packing(byacc_t* S, const char *how, long nused, clock_t ticks)
+{
+    fprintf(stderr,
+	    "%s: %s packing: %ld entries in %ld table slots, %.1f%% dense, %.1f ms\n",
+	    S->myname, how, nused, S->high + 1,
+	    (100.0 * (double)nused) / (double)(S->high + 1),
+	    (1000.0 * (double)ticks) / (double)CLOCKS_PER_SEC);
+}
+
+/*  A packed layout, kept while pack_table tries another.		*/
+
+typedef struct
+{
+    Value_t *base;
+    Value_t *table;
+    Value_t *check;
+    int maxtable;
+    long high;
+}
+layout;
+
+/*  Keep_shorter frees whichever of the current layout and *best gives the	*/
+/*  longer table, leaving the shorter one in *best.			*/
+
+static void
+keep_shorter(byacc_t* S, layout *best)
+{
+    if (best->base != 0 && best->high <= S->high)
+    {
+	FREE(S->base);
+	FREE(S->table);
+	FREE(S->check);
+    }
+    else
+    {
+	if (best->base != 0)
+	{
+	    FREE(best->base);
+	    FREE(best->table);
+	    FREE(best->check);
+	}
+	best->base = S->base;
+	best->table = S->table;
+	best->check = S->check;
+	best->maxtable = S->maxtable;
+	best->high = S->high;
+    }
+}
+
+/*  Pack_table packs the vectors first fit.  With -T, it also tries better	*/
+/*  fit, and first fit with the sparser vectors of each width ahead of	*/
+/*  the denser ones, keeps whichever layout gives the shortest table,	*/
+/*  and reports how each did.						*/
+
+#define BETTER_FIT_WINDOW 16
+
+static void
+pack_table(byacc_t* S)
+{
+    int i;
+    long nused;
+    clock_t start;
+
+    start = clock();
+    nused = pack_pass(S, 0);
+
+    if (S->tight_flag)
+    {
+	layout best;
+
+	report_packing(S, "first fit", nused, clock() - start);
+	best.base = 0;
+	keep_shorter(S, &best);
+
+	start = clock();
+	nused = pack_pass(S, BETTER_FIT_WINDOW);
+	report_packing(S, "better fit", nused, clock() - start);
+	keep_shorter(S, &best);
+
+	start = clock();
+	sort_vectors(S, 1);
+	nused = pack_pass(S, 0);
+	report_packing(S, "fewest first", nused, clock() - start);
+	keep_shorter(S, &best);
+
+	S->base = best.base;
+	S->table = best.table;
+	S->check = best.check;
+	S->maxtable = best.maxtable;
+	S->high = best.high;
+    }
+
     for (i = 0; i < S->nvectors; i++)
     {
 	if (S->froms[i])
@@ -936,7 +1273,6 @@ pack_table(byacc_t* S)
     DO_FREE(S->tos);
     DO_FREE(S->tally);
     DO_FREE(S->width);
-    DO_FREE(S->pos);
 }
 
 static void
@@ -1983,14 +2319,16 @@ output_yydestruct_impl(byacc_t* S)
 static void
 free_itemsets(byacc_t* S)
 {
-    core *cp, *next;
+    core_block *bp, *next;
 
     FREE(S->state_table);
-    for (cp = S->first_state; cp; cp = next)
+    for (bp = S->core_blocks; bp; bp = next)
     {
-	next = cp->next;
-	FREE(cp);
+	next = bp->next;
+	FREE(bp);
     }
+    S->core_blocks = 0;
+    S->first_state = 0;
 }
 
 static void
@@ -0,0 +1,150 @@
+/*
+ * Microbenchmark for warshall.c.  It times reflexive_transitive_closure()
+ * against the plain row-at-a-time Warshall loop it started from, on random
+ * sparse relations like the ones lr0.c and lalr.c close, and checks that
+ * both give the same matrix.  Below BLOCKED_MIN_ROWS the two are the same
+ * loop, so the ratio there shows how noisy the timing is.  Build and run it
+ * from the test directory:
+ *
+ *	cc -O2 -I.. -o warshall_bench warshall_bench.c warshall_ref.c ../warshall.c
+ *	./warshall_bench [size ...]
+ *
+ * The default sizes are 100, 250, 500, 1000, 1500, 2000 and 3000.
+ */
+#include <defs.h>
+#include <time.h>
+
+#define ROUNDS 7
+
+extern void reference_closure(bitword_t *R, int n);
+
+static unsigned long long seed = 1;
+
+static int
+rnd(int n)
+{
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (int) ((seed >> 33) % (unsigned) n);
+}
+
+/*
+ * A few random edges per row, plus a chain through a tenth of the rows,
+ * so that the closure is dense in places and sparse in others.
+ */
+static void
+make_relation(bitword_t *R, int n)
+{
+    int rowsize = WORDSIZE(n);
+    int i, k;
+
+    memset(R, 0, (size_t) n * (size_t) rowsize * sizeof(bitword_t));
+    for (i = 0; i < n; i++)
+    {
+	for (k = rnd(4); k > 0; k--)
+	    SETBIT(R + i * rowsize, rnd(n));
+	if (i % 10 == 0 && i + 10 < n)
+	    SETBIT(R + i * rowsize, i + 10);
+    }
+}
+
+/*
+ * Seconds per call of closure(R, n) over the given number of calls, each
+ * on a fresh copy of the relation T, less the time taken to copy it.  The
+ * call goes through a volatile pointer so that the reference loop is not
+ * inlined here, where warshall.c, in its own file, cannot be.
+ */
+static double
+time_closure(void (*closure) (bitword_t *, int),
+	     bitword_t *R, const bitword_t *T, int n, int calls)
+{
+    void (*volatile call) (bitword_t *, int) = closure;
+    size_t bytes = (size_t) n * (size_t) WORDSIZE(n) * sizeof(bitword_t);
+    clock_t start;
+    clock_t used;
+    int i;
+
+    start = clock();
+    for (i = 0; i < calls; i++)
+    {
+	memcpy(R, T, bytes);
+	call(R, n);
+    }
+    used = clock() - start;
+
+    start = clock();
+    for (i = 0; i < calls; i++)
+    {
+	memcpy(R, T, bytes);
+	if (R[0] == (bitword_t) i)	/* keep the copies from being dropped */
+	    R[0] = 0;
+    }
+    used -= clock() - start;
+    return (double) used / CLOCKS_PER_SEC / calls;
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const int sizes[] =
+    {100, 250, 500, 1000, 1500, 2000, 3000};
+    int count = argc > 1 ? argc - 1 : (int) (sizeof(sizes) / sizeof(sizes[0]));
+    int failed = 0;
+    int i;
+
+    printf("%6s %12s %12s %8s\n", "n", "before (ms)", "after (ms)", "speedup");
+    for (i = 0; i < count; i++)
+    {
+	int n = argc > 1 ? atoi(argv[i + 1]) : sizes[i];
+	size_t words = (size_t) n * (size_t) WORDSIZE(n);
+	bitword_t *T = calloc(words + 1, sizeof(bitword_t));
+	bitword_t *A = calloc(words + 1, sizeof(bitword_t));
+	bitword_t *B = calloc(words + 1, sizeof(bitword_t));
+	double before = 0;
+	double after = 0;
+	int calls;
+	int round;
+
+	if (n <= 0 || T == 0 || A == 0 || B == 0)
+	{
+	    fprintf(stderr, "cannot test size %d\n", n);
+	    return EXIT_FAILURE;
+	}
+
+	seed = (unsigned long long) n;
+	make_relation(T, n);
+	memcpy(A, T, words * sizeof(bitword_t));
+	reference_closure(A, n);
+	memcpy(B, T, words * sizeof(bitword_t));
+	reflexive_transitive_closure(B, n);
+	if (memcmp(A, B, words * sizeof(bitword_t)) != 0)
+	{
+	    printf("%6d closures differ\n", n);
+	    failed = 1;
+	}
+
+	/*
+	 * Take the best of several rounds, alternating the two, as other load
+	 * on the machine only ever makes a round slower.  Each round is sized
+	 * to take about a tenth of a second for the reference loop.
+	 */
+	calls = 1;
+	while (time_closure(reference_closure, A, T, n, calls) * calls < 0.02)
+	    calls *= 2;
+	calls *= 5;
+	for (round = 0; round < ROUNDS; round++)
+	{
+	    double t = time_closure(reference_closure, A, T, n, calls);
+	    if (round == 0 || t < before)
+		before = t;
+	    t = time_closure(reflexive_transitive_closure, B, T, n, calls);
+	    if (round == 0 || t < after)
+		after = t;
+	}
+	printf("%6d %12.3f %12.3f %7.2fx\n", n, before * 1000, after * 1000,
+	       after > 0 ? before / after : 0.0);
+	free(T);
+	free(A);
+	free(B);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -12,6 +12,7 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
 
 #define ISSPACE(X) isspace((unsigned char)(X))
 #define ISDIGIT(X) isdigit((unsigned char)(X))
@@ -39,6 +40,22 @@ extern int access(const char *path, int mode);
 #include <unistd.h>
 #endif
 
+/* The grammar file is mapped into memory instead of read into a buffer
+** where mmap() is available.  Define LEMON_NO_MMAP to always read it. */
+#if !defined(__WIN32__) && !defined(LEMON_NO_MMAP)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#define LEMON_MMAP 1
+#endif
+
+/* The -j option runs some phases on several threads.  Define
+** LEMON_NO_THREADS to build without pthreads; -j is then ignored. */
+#if !defined(__WIN32__) && !defined(LEMON_NO_THREADS)
+#include <pthread.h>
+#define LEMON_THREADS 1
+#endif
+
 /* #define PRIVATE static */
 #define PRIVATE
 
@@ -163,10 +180,7 @@ static void lemon_strcat(char *dest, const char *src){
 struct rule;
 struct lemon;
 struct action;
-struct s_x1;
-struct s_x2;
-struct s_x3;
-struct s_x4;
+struct s_htable;
 
 static struct action *Action_new(struct lemon *lemp);
 static struct action *Action_sort(struct action *);
@@ -177,7 +191,9 @@ void FindFirstSets(struct lemon*);
 void FindStates(struct lemon*);
 void FindLinks(struct lemon*);
 void FindFollowSets(struct lemon*);
+void FindGotoFollowSets(struct lemon*);
 void FindActions(struct lemon*);
+void FindPolicyConflicts(struct lemon*);
 
 /********* From the file "configlist.h" *********************************/
 void Configlist_init(struct lemon *);
@@ -223,18 +239,59 @@ void Reprint(struct lemon *);
 void Reprint_yacc(struct lemon *);
 void ReportSQL(struct lemon *);
 void ReportOutput(struct lemon *);
+void ReportPolicies(struct lemon *);
 void ReportTable(struct lemon *, int);
 void ReportHeader(struct lemon *);
 void CompressTables(struct lemon *);
 void ResortStates(struct lemon *);
+void ProfileStates(struct lemon *);
+void ResolveFallbacks(struct lemon *);
+
+/********** From the file "cache.h" **************************************/
+/* The automaton cache (the -C option).  The key is a serialization of
+** everything in the grammar and the command line that the LR(0) states,
+** lookaheads and final action tables depend upon. */
+struct cache_key {
+  char *z;                 /* The serialized key */
+  size_t n;                /* Bytes used in z[] */
+  size_t nAlloc;           /* Bytes allocated for z[] */
+};
+void Cache_key(struct lemon *, struct cache_key *, int compress, int noResort);
+int Cache_load(struct lemon *, struct cache_key *);
+void Cache_save(struct lemon *, struct cache_key *);
+
+/********** From the file "arena.h" **************************************/
+/* A region allocator.  It owns every configuration, propagation link,
+** action, state and set built while constructing the automaton, so all
+** of them are released together by a single call to Arena_reset(). */
+struct arena_block {
+  struct arena_block *next; /* Previously filled block */
+  size_t size;              /* Bytes available in data[] */
+  size_t used;              /* Bytes of data[] handed out so far */
+  double data[1];           /* Start of the storage (aligned for any type) */
+};
+void *Arena_alloc(struct lemon *, size_t);  /* Zeroed memory from the arena */
+void  Arena_reset(struct lemon *);          /* Free everything in the arena */
+
+/********** From the file "parallel.h" ***********************************/
+/* Work on the items iFirst..iLast-1, which form chunk number iChunk */
+typedef void (*ParallelWork)(struct lemon*, void*, int iChunk,
+                             int iFirst, int iLast);
+int  Parallel_nchunk(struct lemon *, int);  /* Chunks for N items */
+void Parallel_for(struct lemon *, int, ParallelWork, void*);
 
 /********** From the file "set.h" ****************************************/
+/* Sets are packed one bit per element into 64-bit words */
+typedef unsigned long long SetWord;
+#define SETWORD_BITS 64
+
 void  SetSize(struct lemon *, int);             /* All sets will be of size N */
-char *SetNew(struct lemon *);               /* A new set for element 0..N */
-void  SetFree(char*);             /* Deallocate a set */
-int SetAdd(struct lemon *, char*,int);            /* Add element to a set */
-int SetUnion(struct lemon *, char *,char *);    /* A <- A U B, thru element N */
-#define SetFind(X,Y) (X[Y])       /* True if Y is in set X */
+SetWord *SetNew(struct lemon *);            /* A new set for element 0..N */
+void  SetFree(struct lemon *, SetWord*);   /* Deallocate a set */
+int SetAdd(struct lemon *, SetWord*,int);         /* Add element to a set */
+int SetUnion(struct lemon *, SetWord*,SetWord*);  /* A <- A U B, thru element N */
+#define SetFind(X,Y) \
+  (((X)[(Y)/SETWORD_BITS]>>((Y)%SETWORD_BITS))&1)   /* True if Y is in set X */
 
 /********** From the file "struct.h" *************************************/
 /*
@@ -266,7 +323,7 @@ struct symbol {
   struct symbol *fallback; /* fallback token in case this token doesn't parse */
   int prec;                /* Precedence if defined (-1 otherwise) */
   enum e_assoc assoc;      /* Associativity if precedence is defined */
-  char *firstset;          /* First-set for all rules of this symbol */
+  SetWord *firstset;       /* First-set for all rules of this symbol */
   Boolean lambda;          /* True if NT and can generate an empty string */
   int useCnt;              /* Number of times used */
   char *destructor;        /* Code which executes whenever this symbol is
@@ -325,13 +382,14 @@ enum cfgstatus {
 struct config {
   struct rule *rp;         /* The rule upon which the configuration is based */
   int dot;                 /* The parse point */
-  char *fws;               /* Follow-set for this configuration only */
+  SetWord *fws;            /* Follow-set for this configuration only */
   struct plink *fplp;      /* Follow-set forward propagation links */
   struct plink *bplp;      /* Follow-set backwards propagation links */
   struct state *stp;       /* Pointer to state which contains this */
   enum cfgstatus status;   /* used during followset and shift computations */
   struct config *next;     /* Next configuration in the state */
   struct config *bp;       /* The next basis configuration */
+  int index;               /* Sequence number assigned by FindLinks() */
 };
 
 enum e_action {
@@ -359,6 +417,15 @@ struct action {
   struct symbol *spOpt;    /* SHIFTREDUCE optimization to this symbol */
   struct action *next;     /* Next action for this state */
   struct action *collide;  /* Next action with the same hash */
+  int iSeq;                /* Allocation order, used to break sort ties */
+};
+
+/* Conflict counts, for a chunk of states or for one state */
+struct conflict_count {
+  int n;                   /* All conflicts */
+  int nSR;                 /* Shift/reduce conflicts */
+  int nRR;                 /* Reduce/reduce conflicts */
+  int nPrec;               /* Conflicts resolved by precedence */
 };
 
 /* Each state of the generated parser's finite state machine
@@ -373,6 +440,10 @@ struct state {
   int iDfltReduce;         /* Default action is to REDUCE by this rule */
   struct rule *pDfltReduce;/* The default REDUCE rule. */
   int autoReduce;          /* True if this is an auto-reduce state */
+  struct conflict_count *aPolicyCnt; /* Conflicts under each -P policy */
+  unsigned long long nTknHit;  /* Terminal lookups in the -G profile */
+  unsigned long long nNtHit;   /* Nonterminal lookups in the -G profile */
+  unsigned char *aResolved;    /* -F fallback marks per terminal, or NULL */
 };
 #define NO_OFFSET (-2147483647)
 
@@ -384,6 +455,20 @@ struct plink {
   struct plink *next;      /* The next propagate link */
 };
 
+/* The ways of computing the LALR(1) lookaheads (the -L option) */
+enum e_lookahead {
+  LA_PLINK,                /* Propagate follow-sets along config links */
+  LA_DIGRAPH               /* DeRemer-Pennello relations on the gotos */
+};
+
+/* The ways of choosing the precedence of a rule (the -P option) */
+enum e_precpolicy {
+  PREC_LEMON,              /* Leftmost terminal with a precedence */
+  PREC_YACC,               /* Rightmost terminal, as with -z */
+  PREC_NONE                /* No precedence at all, as with -u */
+};
+#define MX_POLICY 3
+
 /* The state vector for the entire parser generator is recorded as
 ** follows.  (LEMON uses no global variables and makes little use of
 ** static variables.  Fields in the following structure can be thought
@@ -443,7 +528,8 @@ struct lemon {
   int showPrecedenceConflict;
   int yaccPrec;            /*Use yacc rule precedence rightmost instead of leftmost*/
   int ignorePrec;          /*Ignore all precedences*/
-  struct action *actionfreelist;
+  struct arena_block *arena;    /* Storage for all automaton objects */
+  int nactionseq;          /* Number of actions allocated so far */
   struct config *freelist;      /* List of free configurations */
   struct config *current;       /* Top of list of configurations */
   struct config **currentend;   /* Last on list of configs */
@@ -460,16 +546,32 @@ struct lemon {
   struct s_options *op;
   FILE *errstream;
   char *templatename;
-  /* There is only one instance of the array, which is the following */
-  struct s_x1 *x1a;
-  /* There is only one instance of the array, which is the following */
-  struct s_x2 *x2a;
-  /* There is only one instance of the array, which is the following */
-  struct s_x3 *x3a;
-  /* There is only one instance of the array, which is the following */
-  struct s_x4 *x4a;
-  int set_size;
+  struct s_htable *x1a;         /* Strings saved by Strsafe() */
+  struct s_htable *x2a;         /* Symbols, keyed by name */
+  struct s_htable *x3a;         /* States, keyed by their basis */
+  struct s_htable *x4a;         /* Configurations of the state being built */
+  int nthread;                  /* Number of threads to use (the -j option) */
+  enum e_lookahead laEngine;    /* How to find lookaheads (the -L option) */
+  int nPolicy;                  /* Number of -P precedence policies */
+  enum e_precpolicy aPolicy[MX_POLICY]; /* The -P policies, in order */
+  struct conflict_count *aPolicyCnt;    /* Counts for all states, policies */
+  int mxCoded;                  /* Most actions to code as switches (-k) */
+  char *zProfile;               /* Runtime profile to lay out for (-G) */
+  int splitStack;               /* Keep values apart from states (-V) */
+  int resolveFallback;          /* Put fallbacks into the tables (-F) */
+  int nFallbackResolved;        /* Table entries added for fallbacks */
+  int nWildcardResolved;        /* Table entries added for the wildcard */
+  int nconfig;                  /* Number of configurations in all states */
+  struct config **cfgarray;     /* All configurations, by config->index */
+  int *linkstart;               /* CSR offsets of forward propagation links */
+  struct config **linkdest;     /* CSR targets of forward propagation links */
+  SetWord *setfreelist;         /* Sets released by SetFree() */
+  int set_size;                 /* Number of elements in every set */
+  int set_words;                /* Number of SetWords in every set */
+  int (*xSetUnion)(SetWord*,const SetWord*,int); /* Union kernel in use */
   int preccounter;
+  char *zStateReport;           /* States section of the report, if cached */
+  size_t nStateReport;          /* Bytes in zStateReport[] */
 };
 
 #define MemoryCheck(X) if((X)==0){ \
@@ -513,7 +615,7 @@ struct symbol **Symbol_arrayof(struct lemon *);
 /* Routines to manage the state table */
 
 int Configcmp(const char *, const char *);
-struct state *State_new();
+struct state *State_new(struct lemon *);
 void State_init(struct lemon *lem);
 void State_deinit(struct lemon *lem);
 int State_insert(struct lemon *lem, struct state *, struct config *);
@@ -537,19 +639,8 @@ void Configtable_clear(struct lemon *lem, int(*)(struct config *));
 static struct action *Action_new(struct lemon *lemp){
   struct action *newaction;
 
-  if( lemp->actionfreelist==0 ){
-    int i;
-    int amt = 100;
-    lemp->actionfreelist = (struct action *)calloc(amt, sizeof(struct action));
-    if( lemp->actionfreelist==0 ){
-      fprintf(stderr,"Unable to allocate memory for a new parser action.");
-      exit(1);
-    }
-    for(i=0; i<amt-1; i++) lemp->actionfreelist[i].next = &lemp->actionfreelist[i+1];
-    lemp->actionfreelist[amt-1].next = 0;
-  }
-  newaction = lemp->actionfreelist;
-  lemp->actionfreelist = lemp->actionfreelist->next;
+  newaction = (struct action *)Arena_alloc(lemp, sizeof(struct action));
+  newaction->iSeq = lemp->nactionseq++;
   return newaction;
 }
 
@@ -570,7 +661,7 @@ static int actioncmp(
     rc = ap1->x.rp->index - ap2->x.rp->index;
   }
   if( rc==0 ){
-    rc = (int) (ap2 - ap1);
+    rc = ap2->iSeq - ap1->iSeq;
   }
   return rc;
 }
@@ -633,6 +724,22 @@ struct lookahead_action {
   int lookahead;             /* Value of the lookahead token */
   int action;                /* Action to take on the given lookahead */
 };
+/*
+** Every transaction set placed into aAction[] sits on its own diagonal:
+** an entry at index X with lookahead L belongs to the diagonal X-L, which
+** is the offset returned by acttab_insert().  A diagonal never holds more
+** than one distinct transaction set.  To find duplicates quickly, each
+** set placed on a new diagonal is also recorded in a hash table keyed by
+** its contents.
+*/
+struct acttab_txn {
+  unsigned int hash;           /* Hash of the sorted transaction set */
+  int iDiag;                   /* The diagonal holding this set */
+  int nEntry;                  /* Number of entries in the set */
+  int iEntry;                  /* First entry in acttab.aTxnEntry[] */
+  int iNext;                   /* Next transaction in the same hash bucket */
+};
+
 typedef struct acttab acttab;
 struct acttab {
   int nAction;                 /* Number of used slots in aAction[] */
@@ -647,6 +754,18 @@ struct acttab {
   int nLookaheadAlloc;         /* Slots allocated in aLookahead[] */
   int nterminal;               /* Number of terminal symbols */
   int nsymbol;                 /* total number of symbols */
+  SetWord *aUsed;              /* One bit for each occupied aAction[] slot */
+  char *aDiagUsed;             /* True for each diagonal holding a set */
+  SetWord *aPattern;           /* Lookahead offsets of the new set, as bits */
+  struct acttab_txn *aTxn;     /* Every distinct transaction set placed */
+  int nTxn;                    /* Used slots in aTxn[] */
+  int nTxnAlloc;               /* Slots allocated in aTxn[] */
+  struct lookahead_action
+    *aTxnEntry;                /* Sorted entries of all aTxn[] sets */
+  int nTxnEntry;               /* Used slots in aTxnEntry[] */
+  int nTxnEntryAlloc;          /* Slots allocated in aTxnEntry[] */
+  int *aTxnHash;               /* Hash buckets of aTxn[], -1 if empty */
+  int nTxnHash;                /* Number of hash buckets.  A power of 2 */
 };
 
 /* Return the number of entries in the yy_action table */
@@ -658,10 +777,23 @@ struct acttab {
 /* The value for the N-th entry in yy_lookahead */
 #define acttab_yylookahead(X,N)  ((X)->aAction[N].lookahead)
 
+/* Number of SetWords in the aUsed[] bitmap for N aAction[] slots.  The
+** slack lets acttab_fits() read one pattern past the last slot. */
+#define acttab_used_words(P,N) (((N)+(P)->nsymbol)/SETWORD_BITS + 3)
+
+/* Index into aDiagUsed[] of diagonal D */
+#define acttab_diag(P,D)  ((D)+(P)->nsymbol)
+
 /* Free all memory associated with the given acttab */
 void acttab_free(acttab *p){
   free( p->aAction );
   free( p->aLookahead );
+  free( p->aUsed );
+  free( p->aDiagUsed );
+  free( p->aPattern );
+  free( p->aTxn );
+  free( p->aTxnEntry );
+  free( p->aTxnHash );
   free( p );
 }
 
@@ -675,6 +807,14 @@ acttab *acttab_alloc(int nsymbol, int nterminal){
   memset(p, 0, sizeof(*p));
   p->nsymbol = nsymbol;
   p->nterminal = nterminal;
+  p->aPattern = (SetWord*)calloc( nsymbol/SETWORD_BITS + 2, sizeof(SetWord) );
+  p->nTxnHash = 256;
+  p->aTxnHash = (int*)malloc( p->nTxnHash*sizeof(int) );
+  if( p->aPattern==0 || p->aTxnHash==0 ){
+    fprintf(stderr,"Unable to allocate memory for a new acttab.");
+    exit(1);
+  }
+  memset(p->aTxnHash, 0xff, p->nTxnHash*sizeof(int));
   return p;
 }
 
@@ -709,6 +849,107 @@ void acttab_action(acttab *p, int lookahead, int action){
   p->nLookahead++;
 }
 
+/* Sort the current transaction set by lookahead and return its hash.
+** The sets are nearly always built in lookahead order already, so an
+** insertion sort is the right tool. */
+static unsigned int acttab_sort_and_hash(acttab *p){
+  int i, j;
+  unsigned int h = 0;
+  for(i=1; i<p->nLookahead; i++){
+    struct lookahead_action x = p->aLookahead[i];
+    for(j=i; j>0 && p->aLookahead[j-1].lookahead>x.lookahead; j--){
+      p->aLookahead[j] = p->aLookahead[j-1];
+    }
+    p->aLookahead[j] = x;
+  }
+  for(i=0; i<p->nLookahead; i++){
+    h = h*1000003 ^ (unsigned int)p->aLookahead[i].lookahead;
+    h = h*1000003 ^ (unsigned int)p->aLookahead[i].action;
+  }
+  return h ^ (unsigned int)p->nLookahead;
+}
+
+/* Return the largest diagonal not less than mnDiag that holds exactly
+** the current (sorted) transaction set, or mnDiag-1 if there is none. */
+static int acttab_find_txn(acttab *p, unsigned int h, int mnDiag){
+  int i, j, best = mnDiag-1;
+  for(i=p->aTxnHash[h & (p->nTxnHash-1)]; i>=0; i=p->aTxn[i].iNext){
+    struct acttab_txn *pTxn = &p->aTxn[i];
+    struct lookahead_action *aEntry;
+    if( pTxn->hash!=h || pTxn->nEntry!=p->nLookahead ) continue;
+    if( pTxn->iDiag<=best ) continue;
+    aEntry = &p->aTxnEntry[pTxn->iEntry];
+    for(j=0; j<p->nLookahead; j++){
+      if( aEntry[j].lookahead!=p->aLookahead[j].lookahead ) break;
+      if( aEntry[j].action!=p->aLookahead[j].action ) break;
+    }
+    if( j==p->nLookahead ) best = pTxn->iDiag;
+  }
+  return best;
+}
+
+/* Remember that the current (sorted) transaction set now lives on
+** diagonal iDiag */
+static void acttab_add_txn(acttab *p, unsigned int h, int iDiag){
+  struct acttab_txn *pTxn;
+  int i;
+  if( p->nTxn>=p->nTxnAlloc ){
+    p->nTxnAlloc = p->nTxnAlloc*2 + 64;
+    p->aTxn = (struct acttab_txn *) realloc( p->aTxn,
+                                 sizeof(p->aTxn[0])*p->nTxnAlloc );
+  }
+  if( p->nTxnEntry+p->nLookahead>p->nTxnEntryAlloc ){
+    p->nTxnEntryAlloc = p->nTxnEntryAlloc*2 + p->nLookahead + 256;
+    p->aTxnEntry = (struct lookahead_action *) realloc( p->aTxnEntry,
+                                 sizeof(p->aTxnEntry[0])*p->nTxnEntryAlloc );
+  }
+  if( p->nTxn>=p->nTxnHash ){
+    p->nTxnHash *= 2;
+    p->aTxnHash = (int*)realloc( p->aTxnHash, p->nTxnHash*sizeof(int) );
+    if( p->aTxnHash ){
+      memset(p->aTxnHash, 0xff, p->nTxnHash*sizeof(int));
+      for(i=0; i<p->nTxn; i++){
+        int b = p->aTxn[i].hash & (p->nTxnHash-1);
+        p->aTxn[i].iNext = p->aTxnHash[b];
+        p->aTxnHash[b] = i;
+      }
+    }
+  }
+  if( p->aTxn==0 || p->aTxnEntry==0 || p->aTxnHash==0 ){
+    fprintf(stderr,"malloc failed\n");
+    exit(1);
+  }
+  pTxn = &p->aTxn[p->nTxn];
+  pTxn->hash = h;
+  pTxn->iDiag = iDiag;
+  pTxn->nEntry = p->nLookahead;
+  pTxn->iEntry = p->nTxnEntry;
+  memcpy(&p->aTxnEntry[p->nTxnEntry], p->aLookahead,
+         sizeof(p->aLookahead[0])*p->nLookahead);
+  p->nTxnEntry += p->nLookahead;
+  pTxn->iNext = p->aTxnHash[h & (p->nTxnHash-1)];
+  p->aTxnHash[h & (p->nTxnHash-1)] = p->nTxn++;
+}
+
+/* Return SETWORD_BITS bits of the aUsed[] bitmap starting at slot i */
+static SetWord acttab_used_bits(acttab *p, int i){
+  int q = i/SETWORD_BITS;
+  int r = i%SETWORD_BITS;
+  if( r==0 ) return p->aUsed[q];
+  return (p->aUsed[q]>>r) | (p->aUsed[q+1]<<(SETWORD_BITS-r));
+}
+
+/* Return true if every slot needed to place the current transaction set
+** at index i (the slot of mnLookahead) is empty.  aPattern[] holds the
+** offsets of the set's lookaheads from mnLookahead. */
+static int acttab_fits(acttab *p, int i){
+  int w, nw = (p->mxLookahead - p->mnLookahead)/SETWORD_BITS + 1;
+  for(w=0; w<nw; w++){
+    if( acttab_used_bits(p, i + w*SETWORD_BITS) & p->aPattern[w] ) return 0;
+  }
+  return 1;
+}
+
 /*
 ** Add the transaction set built up with prior calls to acttab_action()
 ** into the current action table.  Then reset the transaction set back
@@ -723,22 +964,38 @@ void acttab_action(acttab *p, int lookahead, int action){
 ** is false, there is more flexibility in selecting offsets, resulting in
 ** a smaller table.  For non-terminal symbols, which are never syntax errors,
 ** makeItSafe can be false.
+**
+** The offset chosen is the same one a brute force search would pick: the
+** highest existing duplicate of the transaction set if there is one, and
+** otherwise the lowest index that fits in empty slots on an unused diagonal.
+** If nAlign is more than 1, nAlign slots make up a cache line and the set
+** is placed so that it spans as few cache lines as it can: within one
+** line if it is short enough, otherwise starting at the top of a line.
 */
-int acttab_insert(acttab *p, int makeItSafe){
-  int i, j, k, n, end;
+int acttab_insert(acttab *p, int makeItSafe, int nAlign){
+  int i, j, k, n, end, span;
+  unsigned int h;
   assert( p->nLookahead>0 );
 
   /* Make sure we have enough space to hold the expanded action table
   ** in the worst case.  The worst case occurs if the transaction set
   ** must be appended to the current action table
   */
-  n = p->nsymbol + 1;
+  if( nAlign<1 ) nAlign = 1;
+  span = p->mxLookahead - p->mnLookahead + 1;
+  n = p->nsymbol + nAlign;
   if( p->nAction + n >= p->nActionAlloc ){
     int oldAlloc = p->nActionAlloc;
+    int oldWords = oldAlloc ? acttab_used_words(p, oldAlloc) : 0;
+    int newWords;
     p->nActionAlloc = p->nAction + n + p->nActionAlloc + 20;
+    newWords = acttab_used_words(p, p->nActionAlloc);
     p->aAction = (struct lookahead_action *) realloc( p->aAction,
                           sizeof(p->aAction[0])*p->nActionAlloc);
-    if( p->aAction==0 ){
+    p->aUsed = (SetWord*) realloc( p->aUsed, sizeof(SetWord)*newWords );
+    p->aDiagUsed = (char*) realloc( p->aDiagUsed,
+                                    p->nActionAlloc + p->nsymbol );
+    if( p->aAction==0 || p->aUsed==0 || p->aDiagUsed==0 ){
       fprintf(stderr,"malloc failed\n");
       exit(1);
     }
@@ -746,67 +1003,59 @@ int acttab_insert(acttab *p, int makeItSafe){
       p->aAction[i].lookahead = -1;
       p->aAction[i].action = -1;
     }
+    memset(&p->aUsed[oldWords], 0, sizeof(SetWord)*(newWords - oldWords));
+    memset(&p->aDiagUsed[oldAlloc ? oldAlloc + p->nsymbol : 0], 0,
+           p->nActionAlloc - oldAlloc + (oldAlloc ? 0 : p->nsymbol));
   }
 
-  /* Scan the existing action table looking for an offset that is a
-  ** duplicate of the current transaction set.  Fall out of the loop
-  ** if and when the duplicate is found.
-  **
-  ** i is the index in p->aAction[] where p->mnLookahead is inserted.
+  /* Look for an existing diagonal that holds exactly the current
+  ** transaction set.  i is the index in p->aAction[] where p->mnLookahead
+  ** is inserted.
   */
+  h = acttab_sort_and_hash(p);
   end = makeItSafe ? p->mnLookahead : 0;
-  for(i=p->nAction-1; i>=end; i--){
-    if( p->aAction[i].lookahead==p->mnLookahead ){
-      /* All lookaheads and actions in the aLookahead[] transaction
-      ** must match against the candidate aAction[i] entry. */
-      if( p->aAction[i].action!=p->mnAction ) continue;
-      for(j=0; j<p->nLookahead; j++){
-        k = p->aLookahead[j].lookahead - p->mnLookahead + i;
-        if( k<0 || k>=p->nAction ) break;
-        if( p->aLookahead[j].lookahead!=p->aAction[k].lookahead ) break;
-        if( p->aLookahead[j].action!=p->aAction[k].action ) break;
-      }
-      if( j<p->nLookahead ) continue;
-
-      /* No possible lookahead value that is not in the aLookahead[]
-      ** transaction is allowed to match aAction[i] */
-      n = 0;
-      for(j=0; j<p->nAction; j++){
-        if( p->aAction[j].lookahead<0 ) continue;
-        if( p->aAction[j].lookahead==j+p->mnLookahead-i ) n++;
-      }
-      if( n==p->nLookahead ){
-        break;  /* An exact match is found at offset i */
-      }
-    }
-  }
+  i = acttab_find_txn(p, h, end - p->mnLookahead) + p->mnLookahead;
 
   /* If no existing offsets exactly match the current transaction, find an
   ** an empty offset in the aAction[] table in which we can add the
   ** aLookahead[] transaction.
   */
   if( i<end ){
+    int iLimit = p->nActionAlloc - p->mxLookahead;
+    memset(p->aPattern, 0,
+           sizeof(SetWord)*((p->mxLookahead - p->mnLookahead)/SETWORD_BITS+1));
+    for(j=0; j<p->nLookahead; j++){
+      k = p->aLookahead[j].lookahead - p->mnLookahead;
+      p->aPattern[k/SETWORD_BITS] |= ((SetWord)1)<<(k%SETWORD_BITS);
+    }
     /* Look for holes in the aAction[] table that fit the current
-    ** aLookahead[] transaction.  Leave i set to the offset of the hole.
-    ** If no holes are found, i is left at p->nAction, which means the
-    ** transaction will be appended. */
-    i = makeItSafe ? p->mnLookahead : 0;
-    for(; i<p->nActionAlloc - p->mxLookahead; i++){
-      if( p->aAction[i].lookahead<0 ){
-        for(j=0; j<p->nLookahead; j++){
-          k = p->aLookahead[j].lookahead - p->mnLookahead + i;
-          if( k<0 ) break;
-          if( p->aAction[k].lookahead>=0 ) break;
-        }
-        if( j<p->nLookahead ) continue;
-        for(j=0; j<p->nAction; j++){
-          if( p->aAction[j].lookahead==j+p->mnLookahead-i ) break;
-        }
-        if( j==p->nAction ){
-          break;  /* Fits in empty slots */
-        }
+    ** aLookahead[] transaction and whose diagonal is unused.  Leave i set
+    ** to the offset of the hole, or to iLimit if there are none.
+    **
+    ** The diagonal test used to be a scan of aAction[] for any entry with
+    ** aAction[X].lookahead==X-(i-mnLookahead).  That scan also matched
+    ** the -1 lookahead of an empty slot at X==i-mnLookahead-1, so such a
+    ** slot still rules the offset out.  This keeps the tables unchanged. */
+    i = end;
+    while( i<iLimit ){
+      SetWord w = ~acttab_used_bits(p, i);
+      if( w==0 ){ i += SETWORD_BITS; continue; }
+      while( (w&1)==0 ){ w >>= 1; i++; }   /* Skip to the next empty slot */
+      if( i>=iLimit ) break;
+      if( nAlign>1 && (span<=nAlign ? i%nAlign+span>nAlign : i%nAlign!=0) ){
+        i++;
+        continue;   /* Would cross more cache lines than it needs to */
       }
+      k = i - p->mnLookahead - 1;
+      if( !p->aDiagUsed[acttab_diag(p, i - p->mnLookahead)]
+       && (k<0 || k>=p->nAction || acttab_used_bits(p, k)&1)
+       && acttab_fits(p, i) ){
+        break;  /* Fits in empty slots */
+      }
+      i++;
     }
+    if( i>iLimit ) i = iLimit;
+    acttab_add_txn(p, h, i - p->mnLookahead);
   }
   /* Insert transaction set at index i. */
 #if 0
@@ -819,8 +1068,10 @@ int acttab_insert(acttab *p, int makeItSafe){
   for(j=0; j<p->nLookahead; j++){
     k = p->aLookahead[j].lookahead - p->mnLookahead + i;
     p->aAction[k] = p->aLookahead[j];
+    p->aUsed[k/SETWORD_BITS] |= ((SetWord)1)<<(k%SETWORD_BITS);
     if( k>=p->nAction ) p->nAction = k+1;
   }
+  p->aDiagUsed[acttab_diag(p, i - p->mnLookahead)] = 1;
   if( makeItSafe && i+p->nterminal>=p->nAction ) p->nAction = i+p->nterminal+1;
   p->nLookahead = 0;
 
@@ -845,6 +1096,34 @@ int acttab_action_size(acttab *p){
 ** parser generator.
 */
 
+/* Return the precedence symbol that the right-hand side of rp implies.
+** That is the leftmost terminal with a precedence or, if yaccPrec is
+** true, the rightmost terminal provided that it has a precedence.
+*/
+PRIVATE struct symbol *rule_rhs_precsym(struct rule *rp, int yaccPrec)
+{
+  int i, j;
+  struct symbol *use_sp = NULL;
+  for(i=0; i<rp->nrhs; i++){
+    if(use_sp && !yaccPrec) {
+        break;
+    }
+    struct symbol *sp = rp->rhs[i];
+    if( sp->type==MULTITERMINAL ){
+      for(j=0; j<sp->nsubsym; j++){
+        if( sp->subsym[j]->prec>=0 || yaccPrec){
+          use_sp = sp->subsym[j];
+          if(!yaccPrec) break;
+        }
+      }
+    }else if( sp->type == TERMINAL && (sp->prec>=0  || yaccPrec)){
+      use_sp = rp->rhs[i];
+    }
+  }
+  if(use_sp && use_sp->prec >= 0) return use_sp;
+  return 0;
+}
+
 /* Find a precedence symbol of every rule in the grammar.
 **
 ** Those rules which have a precedence symbol coded in the input
@@ -860,26 +1139,7 @@ void FindRulePrecedences(struct lemon *xp)
   if(xp->ignorePrec) return;
   for(rp=xp->rule; rp; rp=rp->next){
     if( rp->precsym==0 ){
-      int i, j;
-      struct symbol *use_sp = NULL;
-      for(i=0; i<rp->nrhs; i++){
-        if(use_sp && !xp->yaccPrec) {
-            break;
-        }
-        struct symbol *sp = rp->rhs[i];
-        if( sp->type==MULTITERMINAL ){
-          for(j=0; j<sp->nsubsym; j++){
-            if( sp->subsym[j]->prec>=0 || xp->yaccPrec){
-              use_sp = sp->subsym[j];
-              if(!xp->yaccPrec) break;
-            }
-          }
-        }else if( sp->type == TERMINAL && (sp->prec>=0  || xp->yaccPrec)){
-          use_sp = rp->rhs[i];
-        }
-      }
-      if(use_sp && use_sp->prec >= 0)
-          rp->precsym = use_sp;
+      rp->precsym = rule_rhs_precsym(rp, xp->yaccPrec);
     }
   }
   return;
@@ -952,11 +1212,14 @@ void FindFirstSets(struct lemon *lemp)
 ** are added to between some states so that the LR(1) follow sets
 ** can be computed later.
 */
-PRIVATE struct state *getstate(struct lemon *);  /* forward reference */
+PRIVATE struct state *getstate(struct lemon *, int *);  /* forward reference */
+PRIVATE void buildshifts(struct lemon *, struct state *); /* Forwd ref */
 void FindStates(struct lemon *lemp)
 {
   struct symbol *sp;
   struct rule *rp;
+  struct state *stp;
+  int isNew;
 
   Configlist_init(lemp);
 
@@ -1001,21 +1264,21 @@ void FindStates(struct lemon *lemp)
     struct config *newcfp;
     rp->lhsStart = 1;
     newcfp = Configlist_addbasis(lemp, rp,0);
-    SetAdd(lemp, newcfp->fws,0);
+    if( newcfp->fws ) SetAdd(lemp, newcfp->fws,0);
   }
 
-  /* Compute the first state.  All other states will be
-  ** computed automatically during the computation of the first one.
-  ** The returned pointer to the first state is not used. */
-  (void)getstate(lemp);
+  /* Compute the first state, then every state reachable from it */
+  stp = getstate(lemp, &isNew);
+  buildshifts(lemp, stp);
   return;
 }
 
 /* Return a pointer to a state which is described by the configuration
-** list which has been built from calls to Configlist_add.
+** list which has been built from calls to Configlist_add.  *pNew is set
+** to true if the state did not exist before.  The successors of a new
+** state are not computed here; that is the job of buildshifts().
 */
-PRIVATE void buildshifts(struct lemon *, struct state *); /* Forwd ref */
-PRIVATE struct state *getstate(struct lemon *lemp)
+PRIVATE struct state *getstate(struct lemon *lemp, int *pNew)
 {
   struct config *cfp, *bp;
   struct state *stp;
@@ -1039,19 +1302,20 @@ PRIVATE struct state *getstate(struct lemon *lemp)
     }
     cfp = Configlist_return(lemp);
     Configlist_eat(lemp, cfp);
+    *pNew = 0;
   }else{
     /* This really is a new state.  Construct all the details */
     Configlist_closure(lemp);    /* Compute the configuration closure */
     Configlist_sort(lemp);           /* Sort the configuration closure */
     cfp = Configlist_return(lemp);   /* Get a pointer to the config list */
-    stp = State_new();           /* A new state structure */
+    stp = State_new(lemp);       /* A new state structure */
     MemoryCheck(stp);
     stp->bp = bp;                /* Remember the configuration basis */
     stp->cfp = cfp;              /* Remember the configuration closure */
     stp->statenum = lemp->nstate++; /* Every state gets a sequence number */
     stp->ap = 0;                 /* No actions, yet. */
     State_insert(lemp, stp,stp->bp);   /* Add to the state table */
-    buildshifts(lemp,stp);       /* Recursively compute successor states */
+    *pNew = 1;
   }
   return stp;
 }
@@ -1072,8 +1336,41 @@ int same_symbol(struct symbol *a, struct symbol *b)
   return 1;
 }
 
-/* Construct all successor states to the given state.  A "successor"
-** state is any state which can be reached by a shift action.
+/* Record that the state "newstp" is reached from the state "stp" by a
+** shift action on the symbol "sp" */
+PRIVATE void addshift(
+  struct lemon *lemp,
+  struct state *stp,
+  struct symbol *sp,
+  struct state *newstp
+){
+  if( sp->type==MULTITERMINAL ){
+    int i;
+    for(i=0; i<sp->nsubsym; i++){
+      Action_add(lemp, &stp->ap,SHIFT,sp->subsym[i],(char*)newstp);
+    }
+  }else{
+    Action_add(lemp, &stp->ap,SHIFT,sp,(char *)newstp);
+  }
+}
+
+/* One entry of the explicit stack used by buildshifts() */
+struct shiftframe {
+  struct state *stp;       /* State whose successors are being built */
+  struct config *cfp;      /* Next configuration of "stp" to look at */
+  struct symbol *sp;       /* Shift symbol waiting for "newstp" to finish */
+  struct state *newstp;    /* New successor not yet linked to "stp" */
+};
+
+/* Construct all successor states to the given state, and all of their
+** successors in turn.  A "successor" state is any state which can be
+** reached by a shift action.
+**
+** The states are visited depth-first using an explicit stack, so the
+** depth of the automaton is not limited by the C stack.  A new successor
+** is finished before the shift that reaches it is recorded, which keeps
+** the state numbers and the order of the actions exactly as they were
+** when this routine and getstate() called each other recursively.
 */
 PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
 {
@@ -1083,15 +1380,48 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
   struct symbol *sp;   /* Symbol following the dot in configuration "cfp" */
   struct symbol *bsp;  /* Symbol following the dot in configuration "bcfp" */
   struct state *newstp; /* A pointer to a successor state */
-
-  /* Each configuration becomes complete after it contributes to a successor
-  ** state.  Initially, all configurations are incomplete */
-  for(cfp=stp->cfp; cfp; cfp=cfp->next) cfp->status = INCOMPLETE;
-
-  /* Loop through all configurations of the state "stp" */
-  for(cfp=stp->cfp; cfp; cfp=cfp->next){
-    if( cfp->status==COMPLETE ) continue;    /* Already used by inner loop */
-    if( cfp->dot>=cfp->rp->nrhs ) continue;  /* Can't shift this config */
+  struct shiftframe *stack = 0;  /* States whose successors are pending */
+  struct shiftframe *top;        /* The frame being worked on */
+  int nstack = 0;                /* Number of frames in use */
+  int nalloc = 0;                /* Number of frames allocated */
+  int isNew;
+
+  while( stp || nstack>0 ){
+    if( stp ){
+      /* Start on the successors of a new state.  Each configuration
+      ** becomes complete after it contributes to a successor state.
+      ** Initially, all configurations are incomplete */
+      if( nstack>=nalloc ){
+        nalloc = nalloc*2 + 64;
+        stack = (struct shiftframe*)realloc(stack, nalloc*sizeof(stack[0]));
+        MemoryCheck(stack);
+      }
+      top = &stack[nstack++];
+      top->stp = stp;
+      top->cfp = stp->cfp;
+      top->sp = 0;
+      top->newstp = 0;
+      for(cfp=stp->cfp; cfp; cfp=cfp->next) cfp->status = INCOMPLETE;
+      stp = 0;
+    }
+    top = &stack[nstack-1];
+    if( top->newstp ){
+      addshift(lemp, top->stp, top->sp, top->newstp);
+      top->newstp = 0;
+    }
+
+    /* Find the next configuration of the state that still has to
+    ** contribute to a successor.  Pop the state when there is none. */
+    for(cfp=top->cfp; cfp; cfp=cfp->next){
+      if( cfp->status==COMPLETE ) continue;    /* Already used by inner loop */
+      if( cfp->dot>=cfp->rp->nrhs ) continue;  /* Can't shift this config */
+      break;
+    }
+    if( cfp==0 ){
+      nstack--;
+      continue;
+    }
+    top->cfp = cfp->next;
     Configlist_reset(lemp);                      /* Reset the new config set */
     sp = cfp->rp->rhs[cfp->dot];             /* Symbol after the dot */
 
@@ -1105,24 +1435,22 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
       if( !same_symbol(bsp,sp) ) continue;      /* Must be same as for "cfp" */
       bcfp->status = COMPLETE;                  /* Mark this config as used */
       newcfg = Configlist_addbasis(lemp, bcfp->rp,bcfp->dot+1);
-      Plink_add(lemp, &newcfg->bplp,bcfp);
+      if( lemp->laEngine==LA_PLINK ) Plink_add(lemp, &newcfg->bplp,bcfp);
     }
 
     /* Get a pointer to the state described by the basis configuration set
-    ** constructed in the preceding loop */
-    newstp = getstate(lemp);
-
-    /* The state "newstp" is reached from the state "stp" by a shift action
-    ** on the symbol "sp" */
-    if( sp->type==MULTITERMINAL ){
-      int i;
-      for(i=0; i<sp->nsubsym; i++){
-        Action_add(lemp, &stp->ap,SHIFT,sp->subsym[i],(char*)newstp);
-      }
+    ** constructed in the preceding loop.  A state seen before is linked
+    ** right away; a new one is linked once its own successors are done. */
+    newstp = getstate(lemp, &isNew);
+    if( isNew ){
+      top->sp = sp;
+      top->newstp = newstp;
+      stp = newstp;
     }else{
-      Action_add(lemp, &stp->ap,SHIFT,sp,(char *)newstp);
+      addshift(lemp, top->stp, sp, newstp);
     }
   }
+  free(stack);
 }
 
 /*
@@ -1130,7 +1458,7 @@ PRIVATE void buildshifts(struct lemon *lemp, struct state *stp)
 */
 void FindLinks(struct lemon *lemp)
 {
-  int i;
+  int i, nlink;
   struct config *cfp, *other;
   struct state *stp;
   struct plink *plp;
@@ -1156,48 +1484,726 @@ void FindLinks(struct lemon *lemp)
       }
     }
   }
+
+  /* Freeze the forward links into a compressed sparse row array:
+  ** the links of configuration N are linkdest[linkstart[N]] through
+  ** linkdest[linkstart[N+1]-1].  This is what FindFollowSets() walks. */
+  lemp->nconfig = 0;
+  nlink = 0;
+  for(i=0; i<lemp->nstate; i++){
+    stp = lemp->sorted[i];
+    for(cfp=stp?stp->cfp:0; cfp; cfp=cfp->next){
+      cfp->index = lemp->nconfig++;
+      for(plp=cfp->fplp; plp; plp=plp->next) nlink++;
+    }
+  }
+  lemp->cfgarray = (struct config**)calloc(lemp->nconfig+1,
+                                           sizeof(struct config*));
+  lemp->linkstart = (int*)calloc(lemp->nconfig+1, sizeof(int));
+  lemp->linkdest = (struct config**)calloc(nlink+1, sizeof(struct config*));
+  MemoryCheck(lemp->cfgarray);
+  MemoryCheck(lemp->linkstart);
+  MemoryCheck(lemp->linkdest);
+  nlink = 0;
+  for(i=0; i<lemp->nstate; i++){
+    stp = lemp->sorted[i];
+    for(cfp=stp?stp->cfp:0; cfp; cfp=cfp->next){
+      lemp->cfgarray[cfp->index] = cfp;
+      lemp->linkstart[cfp->index] = nlink;
+      for(plp=cfp->fplp; plp; plp=plp->next){
+        lemp->linkdest[nlink++] = plp->cfp;
+      }
+    }
+  }
+  lemp->linkstart[lemp->nconfig] = nlink;
+}
+
+/* The strongly connected components of the propagation links, grouped
+** into levels for FindFollowSets().  Every link into a component of
+** level L comes from a component of a lower level.
+*/
+struct follow_scc {
+  int nComp;               /* Number of components */
+  int *aCompStart;         /* Members of component C are aMember[aCompStart[C]..] */
+  int *aMember;            /* Configuration indexes, grouped by component */
+  int *aComp;              /* The component of each configuration */
+  int *aPredStart;         /* Links into configuration N come from */
+  int *aPred;              /* ... aPred[aPredStart[N]..aPredStart[N+1]-1] */
+  int nLevel;              /* Number of levels */
+  int *aLevelStart;        /* Components of level L are aByLevel[aLevelStart[L]..] */
+  int *aByLevel;           /* Component numbers, grouped by level */
+  int iBase;               /* aByLevel[] index of the level being worked on */
+};
+
+/* Find the strongly connected components of the propagation links with
+** Tarjan's algorithm.  The depth-first search uses an explicit stack so
+** that long chains of links do not overflow the C stack.  Components are
+** numbered as they are completed, so every link out of component C goes
+** to component C or to a lower-numbered one.
+*/
+static void follow_scc_find(struct lemon *lemp, struct follow_scc *p){
+  int nNode = lemp->nconfig;
+  int *aStart = lemp->linkstart;
+  int *aIndex = (int*)calloc(nNode+1, sizeof(int));  /* 0 means unvisited */
+  int *aVertex = (int*)calloc(nNode+1, sizeof(int)); /* Tarjan's stack */
+  int *aFrame = (int*)calloc(nNode+1, sizeof(int));  /* DFS stack: nodes */
+  int *aNext = (int*)calloc(nNode+1, sizeof(int));   /* DFS stack: links */
+  int nVertex = 0;
+  int nFrame = 0;
+  int iRoot, x, y, k;
+
+  MemoryCheck(aIndex);
+  MemoryCheck(aVertex);
+  MemoryCheck(aFrame);
+  MemoryCheck(aNext);
+  p->nComp = 0;
+  for(iRoot=0; iRoot<nNode; iRoot++){
+    if( aIndex[iRoot]!=0 ) continue;
+    aVertex[++nVertex] = iRoot;
+    aIndex[iRoot] = nVertex;
+    aFrame[nFrame] = iRoot;
+    aNext[nFrame++] = aStart[iRoot];
+    while( nFrame>0 ){
+      x = aFrame[nFrame-1];
+      k = aNext[nFrame-1];
+      if( k<aStart[x+1] ){
+        aNext[nFrame-1]++;
+        y = lemp->linkdest[k]->index;
+        if( aIndex[y]==0 ){
+          aVertex[++nVertex] = y;
+          aIndex[y] = nVertex;
+          aFrame[nFrame] = y;
+          aNext[nFrame++] = aStart[y];
+        }else if( aIndex[x]>aIndex[y] ){
+          aIndex[x] = aIndex[y];
+        }
+        continue;
+      }
+      nFrame--;
+      if( aVertex[aIndex[x]]==x ){
+        do{
+          y = aVertex[nVertex--];
+          aIndex[y] = INT_MAX;
+          p->aComp[y] = p->nComp;
+        }while( y!=x );
+        p->nComp++;
+      }
+      if( nFrame>0 ){
+        y = aFrame[nFrame-1];
+        if( aIndex[y]>aIndex[x] ) aIndex[y] = aIndex[x];
+      }
+    }
+  }
+  free(aIndex);
+  free(aVertex);
+  free(aFrame);
+  free(aNext);
+}
+
+/* Fill in everything in *p from the propagation links */
+static void follow_scc_build(struct lemon *lemp, struct follow_scc *p){
+  int nNode = lemp->nconfig;
+  int nLink = lemp->linkstart[nNode];
+  int *aLevel;
+  int i, k, c, d;
+
+  p->aComp = (int*)calloc(nNode+1, sizeof(int));
+  MemoryCheck(p->aComp);
+  follow_scc_find(lemp, p);
+
+  /* Group the configurations by component, and the links by target */
+  p->aCompStart = (int*)calloc(p->nComp+2, sizeof(int));
+  p->aMember = (int*)calloc(nNode+1, sizeof(int));
+  p->aPredStart = (int*)calloc(nNode+2, sizeof(int));
+  p->aPred = (int*)calloc(nLink+1, sizeof(int));
+  MemoryCheck(p->aCompStart);
+  MemoryCheck(p->aMember);
+  MemoryCheck(p->aPredStart);
+  MemoryCheck(p->aPred);
+  for(i=0; i<nNode; i++) p->aCompStart[p->aComp[i]+2]++;
+  for(c=0; c<p->nComp; c++) p->aCompStart[c+2] += p->aCompStart[c+1];
+  for(i=0; i<nNode; i++) p->aMember[p->aCompStart[p->aComp[i]+1]++] = i;
+  for(k=0; k<nLink; k++) p->aPredStart[lemp->linkdest[k]->index+2]++;
+  for(i=0; i<nNode; i++) p->aPredStart[i+2] += p->aPredStart[i+1];
+  for(i=0; i<nNode; i++){
+    for(k=lemp->linkstart[i]; k<lemp->linkstart[i+1]; k++){
+      p->aPred[p->aPredStart[lemp->linkdest[k]->index+1]++] = i;
+    }
+  }
+
+  /* The level of a component is one more than the highest level among
+  ** the components that link into it.  Links only go to lower-numbered
+  ** components, so taking them from the highest number down visits every
+  ** component after all of its predecessors. */
+  aLevel = (int*)calloc(p->nComp+1, sizeof(int));
+  MemoryCheck(aLevel);
+  p->nLevel = 0;
+  for(c=p->nComp-1; c>=0; c--){
+    if( aLevel[c]>=p->nLevel ) p->nLevel = aLevel[c]+1;
+    for(i=p->aCompStart[c]; i<p->aCompStart[c+1]; i++){
+      int x = p->aMember[i];
+      for(k=lemp->linkstart[x]; k<lemp->linkstart[x+1]; k++){
+        d = p->aComp[lemp->linkdest[k]->index];
+        if( d!=c && aLevel[d]<=aLevel[c] ) aLevel[d] = aLevel[c]+1;
+      }
+    }
+  }
+  p->aLevelStart = (int*)calloc(p->nLevel+2, sizeof(int));
+  p->aByLevel = (int*)calloc(p->nComp+1, sizeof(int));
+  MemoryCheck(p->aLevelStart);
+  MemoryCheck(p->aByLevel);
+  for(c=0; c<p->nComp; c++) p->aLevelStart[aLevel[c]+2]++;
+  for(i=0; i<p->nLevel; i++) p->aLevelStart[i+2] += p->aLevelStart[i+1];
+  for(c=0; c<p->nComp; c++) p->aByLevel[p->aLevelStart[aLevel[c]+1]++] = c;
+  free(aLevel);
+}
+
+/* Finish the followsets of the components aByLevel[iBase+iFirst] through
+** aByLevel[iBase+iLast-1], which are all on the same level.
+**
+** The followset of a component is the union of the followsets its
+** members started with and the finished followsets of every
+** configuration that links into it, all of which are on lower levels.
+** Only members of these components are written, so components of the
+** same level can be done on different threads.
+*/
+static void followset_work(
+  struct lemon *lemp,
+  void *pArg,
+  int iChunk,
+  int iFirst,
+  int iLast
+){
+  struct follow_scc *p = (struct follow_scc*)pArg;
+  int nWord = lemp->set_words;
+  int j, i, k, c;
+
+  (void)iChunk;
+  for(j=iFirst; j<iLast; j++){
+    SetWord *pAcc;
+    c = p->aByLevel[p->iBase+j];
+    pAcc = lemp->cfgarray[p->aMember[p->aCompStart[c]]]->fws;
+    for(i=p->aCompStart[c]; i<p->aCompStart[c+1]; i++){
+      int x = p->aMember[i];
+      if( i>p->aCompStart[c] ){
+        lemp->xSetUnion(pAcc, lemp->cfgarray[x]->fws, nWord);
+      }
+      for(k=p->aPredStart[x]; k<p->aPredStart[x+1]; k++){
+        if( p->aComp[p->aPred[k]]==c ) continue;
+        lemp->xSetUnion(pAcc, lemp->cfgarray[p->aPred[k]]->fws, nWord);
+      }
+    }
+    for(i=p->aCompStart[c]+1; i<p->aCompStart[c+1]; i++){
+      memcpy(lemp->cfgarray[p->aMember[i]]->fws, pAcc, nWord*sizeof(SetWord));
+    }
+  }
+}
+
+/* A level with fewer components than this is not worth starting
+** threads for */
+#define FOLLOW_MIN_PARALLEL 64
+
+/* Compute the followsets on one thread.  Every configuration starts out
+** on a FIFO worklist.  A configuration is put back on the list only when
+** the followset of one of its predecessors grows, so configurations that
+** have settled are never visited again.  A configuration is on the list
+** exactly when its status is INCOMPLETE, which bounds the list at
+** lemp->nconfig entries.
+*/
+static void followset_worklist(struct lemon *lemp)
+{
+  int i, k;
+  struct config *cfp, *other;
+  struct config **queue;
+  int head, count;
+
+  queue = (struct config**)calloc(lemp->nconfig+1, sizeof(struct config*));
+  MemoryCheck(queue);
+  for(i=0; i<lemp->nconfig; i++){
+    cfp = lemp->cfgarray[i];
+    cfp->status = INCOMPLETE;
+    queue[i] = cfp;
+  }
+  head = 0;
+  count = lemp->nconfig;
+
+  while( count>0 ){
+    cfp = queue[head];
+    if( ++head==lemp->nconfig ) head = 0;
+    count--;
+    cfp->status = COMPLETE;
+    for(k=lemp->linkstart[cfp->index]; k<lemp->linkstart[cfp->index+1]; k++){
+      other = lemp->linkdest[k];
+      if( SetUnion(lemp, other->fws,cfp->fws) && other->status==COMPLETE ){
+        other->status = INCOMPLETE;
+        i = head + count;
+        if( i>=lemp->nconfig ) i -= lemp->nconfig;
+        queue[i] = other;
+        count++;
+      }
+    }
+  }
+  free(queue);
+}
+
+/* Compute the followsets with -j.  All the configurations of a strongly
+** connected component of the links get the same followset, so each
+** component is finished in one step, once the components that link into
+** it are finished.  The components are grouped into levels such that no
+** two on the same level depend on each other, and the components of each
+** level are split among the threads.
+*/
+static void followset_levels(struct lemon *lemp)
+{
+  struct follow_scc scc;
+  int i, n;
+
+  memset(&scc, 0, sizeof(scc));
+  follow_scc_build(lemp, &scc);
+  for(i=0; i<scc.nLevel; i++){
+    scc.iBase = scc.aLevelStart[i];
+    n = scc.aLevelStart[i+1] - scc.iBase;
+    if( n<FOLLOW_MIN_PARALLEL ){
+      followset_work(lemp, &scc, 0, 0, n);
+    }else{
+      Parallel_for(lemp, n, followset_work, &scc);
+    }
+  }
+  free(scc.aCompStart);
+  free(scc.aMember);
+  free(scc.aComp);
+  free(scc.aPredStart);
+  free(scc.aPred);
+  free(scc.aLevelStart);
+  free(scc.aByLevel);
 }
 
 /* Compute all followsets.
 **
 ** A followset is the set of all symbols which can come immediately
-** after a configuration.
+** after a configuration.  It is the union of the followset the
+** configuration started with and those of every configuration that
+** reaches it along the propagation links.
+**
+** Finding the components and levels for threads costs several times
+** what the worklist takes in all, so one thread uses the worklist.
 */
 void FindFollowSets(struct lemon *lemp)
 {
+  if( lemp->nthread>1 ){
+    followset_levels(lemp);
+  }else{
+    followset_worklist(lemp);
+  }
+  free(lemp->cfgarray);
+  free(lemp->linkstart);
+  free(lemp->linkdest);
+  lemp->cfgarray = 0;
+  lemp->linkstart = 0;
+  lemp->linkdest = 0;
+}
+
+/* One nonterminal transition, for FindGotoFollowSets() */
+struct gotoedge {
+  int iSym;                /* Index of the symbol shifted */
+  struct state *stp;       /* The state reached by the shift */
+  int iNode;               /* Transition number if iSym is a nonterminal */
+};
+
+static int gotoedgecmp(const void *a, const void *b){
+  const struct gotoedge *pA = (const struct gotoedge*)a;
+  const struct gotoedge *pB = (const struct gotoedge*)b;
+  if( pA->iSym!=pB->iSym ) return pA->iSym - pB->iSym;
+  return pA->stp->statenum - pB->stp->statenum;
+}
+
+/* Return the index in aEdge[] of the shift out of state number "iState"
+** on rp->rhs[dot] which moves the dot of rule "rp" past it, or -1 if
+** there is none.  If rp is NULL, any shift on "sp" will do.
+**
+** The shifts of every state are sorted by symbol and then by target.
+** A multi-terminal shifts on each of its members to the same state, so
+** any one member will do.  But a terminal may be shifted both as itself
+** and as a member of a multi-terminal, to different states, and then
+** only the state whose basis holds "rp" with its dot at dot+1 is right.
+*/
+static int goto_find(
+  int *aEdgeStart,
+  struct gotoedge *aEdge,
+  int iState,
+  struct symbol *sp,
+  struct rule *rp,
+  int dot
+){
+  int lo = aEdgeStart[iState];
+  int hi = aEdgeStart[iState+1];
+  int iSym = sp->type==MULTITERMINAL ? sp->subsym[0]->index : sp->index;
+  struct config *cfp;
+
+  /* Find the first shift on iSym */
+  while( lo<hi ){
+    int mid = (lo+hi)/2;
+    if( aEdge[mid].iSym<iSym ) lo = mid+1;
+    else hi = mid;
+  }
+  hi = aEdgeStart[iState+1];
+  if( lo>=hi || aEdge[lo].iSym!=iSym ) return -1;
+  if( rp==0 || lo+1>=hi || aEdge[lo+1].iSym!=iSym ) return lo;
+  for(; lo<hi && aEdge[lo].iSym==iSym; lo++){
+    for(cfp=aEdge[lo].stp->bp; cfp; cfp=cfp->bp){
+      if( cfp->rp==rp && cfp->dot==dot+1 ) return lo;
+    }
+  }
+  return -1;
+}
+
+/* Build a compressed sparse row graph out of nEdge (from,to) pairs
+** in aPair[].  The successors of node N are (*paDest)[(*paStart)[N]]
+** through (*paDest)[(*paStart)[N+1]-1].
+*/
+static void relation_build(
+  int nNode,
+  int nEdge,
+  const int *aPair,
+  int **paStart,
+  int **paDest
+){
+  int *aStart = (int*)calloc(nNode+2, sizeof(int));
+  int *aDest = (int*)calloc(nEdge+1, sizeof(int));
   int i;
+  MemoryCheck(aStart);
+  MemoryCheck(aDest);
+  for(i=0; i<nEdge; i++) aStart[aPair[i*2]+2]++;
+  for(i=0; i<nNode; i++) aStart[i+2] += aStart[i+1];
+  for(i=0; i<nEdge; i++) aDest[aStart[aPair[i*2]+1]++] = aPair[i*2+1];
+  *paStart = aStart;
+  *paDest = aDest;
+}
+
+/* Close the sets of the nodes of a graph under a relation.  When this
+** routine returns, the set of every node is the union of its original set
+** and the original sets of every node reachable from it.
+**
+** This is the DIGRAPH procedure of DeRemer and Pennello.  A strongly
+** connected component is found with Tarjan's algorithm and all of its
+** members get the same set.  The depth-first search uses an explicit
+** stack so that long chains of relations do not overflow the C stack.
+*/
+static void digraph(
+  struct lemon *lemp,
+  int nNode,               /* Number of nodes */
+  const int *aStart,       /* CSR offsets of the relation */
+  const int *aDest,        /* CSR targets of the relation */
+  SetWord *aSet            /* lemp->set_words words for each node */
+){
+  int nWord = lemp->set_words;
+  int *aIndex = (int*)calloc(nNode+1, sizeof(int));  /* 0 means unvisited */
+  int *aVertex = (int*)calloc(nNode+1, sizeof(int)); /* Tarjan's stack */
+  int *aFrame = (int*)calloc(nNode+1, sizeof(int));  /* DFS stack: nodes */
+  int *aNext = (int*)calloc(nNode+1, sizeof(int));   /* DFS stack: edges */
+  int nVertex = 0;
+  int nFrame = 0;
+  int iRoot, x, y, k;
+
+  MemoryCheck(aIndex);
+  MemoryCheck(aVertex);
+  MemoryCheck(aFrame);
+  MemoryCheck(aNext);
+  for(iRoot=0; iRoot<nNode; iRoot++){
+    if( aIndex[iRoot]!=0 ) continue;
+    aVertex[++nVertex] = iRoot;
+    aIndex[iRoot] = nVertex;
+    aFrame[nFrame] = iRoot;
+    aNext[nFrame++] = aStart[iRoot];
+    while( nFrame>0 ){
+      x = aFrame[nFrame-1];
+      k = aNext[nFrame-1];
+      if( k<aStart[x+1] ){
+        aNext[nFrame-1]++;
+        y = aDest[k];
+        if( aIndex[y]==0 ){
+          aVertex[++nVertex] = y;
+          aIndex[y] = nVertex;
+          aFrame[nFrame] = y;
+          aNext[nFrame++] = aStart[y];
+          continue;
+        }
+        if( aIndex[x]>aIndex[y] ) aIndex[x] = aIndex[y];
+        lemp->xSetUnion(&aSet[(size_t)x*nWord], &aSet[(size_t)y*nWord], nWord);
+        continue;
+      }
+
+      /* Every successor of x is finished.  If x is the root of a
+      ** strongly connected component, pop the whole component. */
+      nFrame--;
+      if( aVertex[aIndex[x]]==x ){
+        do{
+          y = aVertex[nVertex--];
+          aIndex[y] = INT_MAX;
+          if( y!=x ){
+            memcpy(&aSet[(size_t)y*nWord], &aSet[(size_t)x*nWord],
+                   nWord*sizeof(SetWord));
+          }
+        }while( y!=x );
+      }
+      if( nFrame>0 ){
+        y = aFrame[nFrame-1];
+        if( aIndex[y]>aIndex[x] ) aIndex[y] = aIndex[x];
+        lemp->xSetUnion(&aSet[(size_t)y*nWord], &aSet[(size_t)x*nWord], nWord);
+      }
+    }
+  }
+  free(aIndex);
+  free(aVertex);
+  free(aFrame);
+  free(aNext);
+}
+
+/* Compute the follow-set of every reducible configuration using the
+** relations of DeRemer and Pennello, as byacc does, instead of by
+** propagating along the configuration links.  The result is the same
+** LALR(1) lookaheads that FindLinks() and FindFollowSets() find.
+**
+** A set of terminals is kept for each nonterminal transition (p,A),
+** which is far fewer sets than one for each configuration:
+**
+**    Read(p,A)   = the terminals shifted out of goto(p,A), plus the sets
+**                  of every (goto(p,A),C) with C nullable ("reads").
+**    Follow(p,A) = Read(p,A) plus the sets of every (p',B) such that
+**                  B ::= x A y, p' reaches p on x, and y is nullable
+**                  ("includes").
+**
+** A completed configuration A ::= w. in state q then gets Follow(p,A)
+** for every p which reaches q on w ("lookback").  LEMON has no augmented
+** start rule, so the transition out of state 0 on the start symbol, which
+** is created if it does not exist, also gets the end-of-input symbol.
+*/
+void FindGotoFollowSets(struct lemon *lemp)
+{
+  int nstate = lemp->nstate;
+  int nWord = lemp->set_words;
+  int *aEdgeStart;          /* Shifts out of state N are aEdge[aEdgeStart[N]..] */
+  struct gotoedge *aEdge;   /* All shifts, sorted by state then symbol */
+  int nEdge;
+  int nNode;                /* Number of nonterminal transitions */
+  int *aNodeState;          /* The state "p" of each transition */
+  struct symbol **aNodeSym; /* The nonterminal "A" of each transition */
+  int *aNodeEdge;           /* aEdge[] index of each transition, or -1 */
+  int iStartNode;           /* The transition on the start symbol */
+  SetWord *aSet;            /* nWord words of Read or Follow per transition */
+  int *aPair;               /* (from,to) pairs of a relation */
+  int nPair, nPairAlloc;
+  int *aRelStart, *aRelDest;
+  struct config **aLbCfg;   /* Lookback: configurations... */
+  int *aLbNode;             /* ...and the transitions they look back to */
+  int nLb, nLbAlloc;
+  struct symbol *spStart;
+  struct state *stp;
   struct config *cfp;
-  struct plink *plp;
-  int progress;
-  int change;
+  struct action *ap;
+  struct rule *rp;
+  int i, j, k, x;
 
-  for(i=0; i<lemp->nstate; i++){
-    assert( lemp->sorted[i]!=0 );
+  /* Give every reducible configuration an empty follow-set */
+  for(i=0; i<nstate; i++){
     for(cfp=lemp->sorted[i]->cfp; cfp; cfp=cfp->next){
-      cfp->status = INCOMPLETE;
+      if( cfp->dot==cfp->rp->nrhs && cfp->fws==0 ) cfp->fws = SetNew(lemp);
     }
   }
 
-  do{
-    progress = 0;
-    for(i=0; i<lemp->nstate; i++){
-      assert( lemp->sorted[i]!=0 );
-      for(cfp=lemp->sorted[i]->cfp; cfp; cfp=cfp->next){
-        if( cfp->status==COMPLETE ) continue;
-        for(plp=cfp->fplp; plp; plp=plp->next){
-          change = SetUnion(lemp, plp->cfp->fws,cfp->fws);
-          if( change ){
-            plp->cfp->status = INCOMPLETE;
-            progress = 1;
+  /* Collect the shifts of every state, sorted by symbol */
+  nEdge = 0;
+  for(i=0; i<nstate; i++){
+    for(ap=lemp->sorted[i]->ap; ap; ap=ap->next){
+      if( ap->type==SHIFT ) nEdge++;
+    }
+  }
+  aEdgeStart = (int*)calloc(nstate+1, sizeof(int));
+  aEdge = (struct gotoedge*)calloc(nEdge+1, sizeof(struct gotoedge));
+  MemoryCheck(aEdgeStart);
+  MemoryCheck(aEdge);
+  nEdge = 0;
+  for(i=0; i<nstate; i++){
+    aEdgeStart[i] = nEdge;
+    for(ap=lemp->sorted[i]->ap; ap; ap=ap->next){
+      if( ap->type!=SHIFT ) continue;
+      aEdge[nEdge].iSym = ap->sp->index;
+      aEdge[nEdge].stp = ap->x.stp;
+      aEdge[nEdge].iNode = -1;
+      nEdge++;
+    }
+    qsort(&aEdge[aEdgeStart[i]], nEdge-aEdgeStart[i], sizeof(aEdge[0]),
+          gotoedgecmp);
+  }
+  aEdgeStart[nstate] = nEdge;
+
+  /* Number the nonterminal transitions.  Add one for the start symbol
+  ** out of state 0 if there is none. */
+  spStart = lemp->sorted[0]->bp->rp->lhs;
+  nNode = 0;
+  for(i=0; i<nEdge; i++){
+    if( aEdge[i].iSym>=lemp->nterminal ) aEdge[i].iNode = nNode++;
+  }
+  k = goto_find(aEdgeStart, aEdge, 0, spStart, 0, 0);
+  iStartNode = k>=0 ? aEdge[k].iNode : nNode++;
+  aNodeState = (int*)calloc(nNode, sizeof(int));
+  aNodeSym = (struct symbol**)calloc(nNode, sizeof(struct symbol*));
+  aNodeEdge = (int*)calloc(nNode, sizeof(int));
+  aSet = (SetWord*)calloc((size_t)nNode*nWord, sizeof(SetWord));
+  MemoryCheck(aNodeState);
+  MemoryCheck(aNodeSym);
+  MemoryCheck(aNodeEdge);
+  MemoryCheck(aSet);
+  aNodeEdge[iStartNode] = -1;
+  for(i=0; i<nstate; i++){
+    for(k=aEdgeStart[i]; k<aEdgeStart[i+1]; k++){
+      x = aEdge[k].iNode;
+      if( x<0 ) continue;
+      aNodeState[x] = i;
+      aNodeSym[x] = lemp->symbols[aEdge[k].iSym];
+      aNodeEdge[x] = k;
+    }
+  }
+  aNodeState[iStartNode] = 0;
+  aNodeSym[iStartNode] = spStart;
+  SetAdd(lemp, &aSet[(size_t)iStartNode*nWord], 0);
+
+  /* Direct reads, and the "reads" relation */
+  nPair = 0;
+  nPairAlloc = 1024;
+  aPair = (int*)malloc(nPairAlloc*2*sizeof(int));
+  MemoryCheck(aPair);
+  for(x=0; x<nNode; x++){
+    if( aNodeEdge[x]<0 ) continue;
+    stp = aEdge[aNodeEdge[x]].stp;
+    for(k=aEdgeStart[stp->statenum]; k<aEdgeStart[stp->statenum+1]; k++){
+      if( aEdge[k].iSym<lemp->nterminal ){
+        SetAdd(lemp, &aSet[(size_t)x*nWord], aEdge[k].iSym);
+      }else if( lemp->symbols[aEdge[k].iSym]->lambda ){
+        if( nPair>=nPairAlloc ){
+          nPairAlloc *= 2;
+          aPair = (int*)realloc(aPair, nPairAlloc*2*sizeof(int));
+          MemoryCheck(aPair);
+        }
+        aPair[nPair*2] = x;
+        aPair[nPair*2+1] = aEdge[k].iNode;
+        nPair++;
+      }
+    }
+  }
+  relation_build(nNode, nPair, aPair, &aRelStart, &aRelDest);
+  digraph(lemp, nNode, aRelStart, aRelDest, aSet);
+  free(aRelStart);
+  free(aRelDest);
+
+  /* Walk every rule of every transition to find the "includes" and
+  ** "lookback" relations */
+  nPair = 0;
+  nLb = 0;
+  nLbAlloc = 1024;
+  aLbCfg = (struct config**)malloc(nLbAlloc*sizeof(struct config*));
+  aLbNode = (int*)malloc(nLbAlloc*sizeof(int));
+  MemoryCheck(aLbCfg);
+  MemoryCheck(aLbNode);
+  for(x=0; x<nNode; x++){
+    for(rp=aNodeSym[x]->rule; rp; rp=rp->nextlhs){
+      int iNullable;   /* rhs[iNullable..] are all nullable */
+      for(iNullable=rp->nrhs; iNullable>0; iNullable--){
+        struct symbol *sp = rp->rhs[iNullable-1];
+        if( sp->type!=NONTERMINAL || !sp->lambda ) break;
+      }
+      i = aNodeState[x];
+      for(j=0; j<rp->nrhs; j++){
+        k = goto_find(aEdgeStart, aEdge, i, rp->rhs[j], rp, j);
+        if( k<0 ){
+          fprintf(stderr, "internal error on source line %d: no shift on %s "
+                  "out of state %d\n", __LINE__, rp->rhs[j]->name, i);
+          exit(1);
+        }
+        if( aEdge[k].iNode>=0 && j+1>=iNullable ){
+          if( nPair>=nPairAlloc ){
+            nPairAlloc *= 2;
+            aPair = (int*)realloc(aPair, nPairAlloc*2*sizeof(int));
+            MemoryCheck(aPair);
           }
+          aPair[nPair*2] = aEdge[k].iNode;
+          aPair[nPair*2+1] = x;
+          nPair++;
         }
-        cfp->status = COMPLETE;
+        i = aEdge[k].stp->statenum;
+      }
+
+      /* Only the configurations of empty rules are outside the basis */
+      stp = lemp->sorted[i];
+      for(cfp=rp->nrhs ? stp->bp : stp->cfp; cfp;
+          cfp=rp->nrhs ? cfp->bp : cfp->next){
+        if( cfp->rp==rp && cfp->dot==rp->nrhs ) break;
       }
+      if( cfp==0 ){
+        fprintf(stderr, "internal error on source line %d: rule %d is not "
+                "complete in state %d\n", __LINE__, rp->iRule, i);
+        exit(1);
+      }
+      if( nLb>=nLbAlloc ){
+        nLbAlloc *= 2;
+        aLbCfg = (struct config**)realloc(aLbCfg,
+                                          nLbAlloc*sizeof(struct config*));
+        aLbNode = (int*)realloc(aLbNode, nLbAlloc*sizeof(int));
+        MemoryCheck(aLbCfg);
+        MemoryCheck(aLbNode);
+      }
+      aLbCfg[nLb] = cfp;
+      aLbNode[nLb] = x;
+      nLb++;
     }
-  }while( progress );
+  }
+  relation_build(nNode, nPair, aPair, &aRelStart, &aRelDest);
+  digraph(lemp, nNode, aRelStart, aRelDest, aSet);
+  free(aRelStart);
+  free(aRelDest);
+  free(aPair);
+
+  /* Hand the follow-sets to the reducible configurations */
+  for(i=0; i<nLb; i++){
+    lemp->xSetUnion(aLbCfg[i]->fws, &aSet[(size_t)aLbNode[i]*nWord], nWord);
+  }
+  free(aLbCfg);
+  free(aLbNode);
+  free(aSet);
+  free(aNodeState);
+  free(aNodeSym);
+  free(aNodeEdge);
+  free(aEdge);
+  free(aEdgeStart);
 }
 
-static int resolve_conflict(struct lemon *lemp, struct action *,struct action *);
+static int resolve_conflict(struct action *,struct action *,int*,int*);
+
+/* Sort the actions of states iFirst..iLast-1 and resolve their conflicts */
+static void conflict_work(
+  struct lemon *lemp,
+  void *pArg,
+  int iChunk,
+  int iFirst,
+  int iLast
+){
+  struct conflict_count *pCnt = &((struct conflict_count*)pArg)[iChunk];
+  struct state *stp;
+  int i;
+  for(i=iFirst; i<iLast; i++){
+    struct action *ap, *nap;
+    stp = lemp->sorted[i];
+    /* assert( stp->ap ); */
+    stp->ap = Action_sort(stp->ap);
+    for(ap=stp->ap; ap && ap->next; ap=ap->next){
+      for(nap=ap->next; nap && nap->sp==ap->sp; nap=nap->next){
+         /* The two actions "ap" and "nap" have the same lookahead.
+         ** Figure out which one should be used */
+         pCnt->n += resolve_conflict(ap,nap,&pCnt->nSR,&pCnt->nRR);
+      }
+    }
+  }
+}
 
 /* Compute the reduce actions, and resolve conflicts.
 */
@@ -1208,6 +2214,8 @@ void FindActions(struct lemon *lemp)
   struct state *stp;
   struct symbol *sp;
   struct rule *rp;
+  struct conflict_count *aCnt;
+  int nchunk;
 
   /* Add all of the reduce actions
   ** A reduce action is added for each element of the followset of
@@ -1247,20 +2255,22 @@ void FindActions(struct lemon *lemp)
   ** start nonterminal.  */
   Action_add(lemp, &lemp->sorted[0]->ap,ACCEPT,sp,0);
 
-  /* Resolve conflicts */
-  for(i=0; i<lemp->nstate; i++){
-    struct action *ap, *nap;
-    stp = lemp->sorted[i];
-    /* assert( stp->ap ); */
-    stp->ap = Action_sort(stp->ap);
-    for(ap=stp->ap; ap && ap->next; ap=ap->next){
-      for(nap=ap->next; nap && nap->sp==ap->sp; nap=nap->next){
-         /* The two actions "ap" and "nap" have the same lookahead.
-         ** Figure out which one should be used */
-         lemp->nconflict += resolve_conflict(lemp, ap,nap);
-      }
-    }
+  /* Measure the conflicts under each of the -P precedence policies,
+  ** while the action lists are still unresolved */
+  if( lemp->nPolicy ) FindPolicyConflicts(lemp);
+
+  /* Resolve conflicts.  Each state is independent of the others, so
+  ** this is split among the -j threads. */
+  nchunk = Parallel_nchunk(lemp, lemp->nstate);
+  aCnt = (struct conflict_count*)calloc(nchunk, sizeof(aCnt[0]));
+  MemoryCheck(aCnt);
+  Parallel_for(lemp, lemp->nstate, conflict_work, aCnt);
+  for(i=0; i<nchunk; i++){
+    lemp->nconflict += aCnt[i].n;
+    lemp->nconflict_sr += aCnt[i].nSR;
+    lemp->nconflict_rr += aCnt[i].nRR;
   }
+  free(aCnt);
 
   /* Report an error for each rule that can never be reduced. */
   for(rp=lemp->rule; rp; rp=rp->next) rp->canReduce = LEMON_FALSE;
@@ -1291,9 +2301,10 @@ void FindActions(struct lemon *lemp)
 ** function won't work if apx->type==REDUCE and apy->type==SHIFT.
 */
 static int resolve_conflict(
-  struct lemon *lemp,
   struct action *apx,
-  struct action *apy
+  struct action *apy,
+  int *pnSR,               /* Incremented for each shift/reduce conflict */
+  int *pnRR                /* Incremented for each reduce/reduce conflict */
 ){
   struct symbol *spx, *spy;
   int errcnt = 0;
@@ -1309,7 +2320,7 @@ static int resolve_conflict(
       /* Not enough precedence information. */
       apy->type = SRCONFLICT;
       errcnt++;
-      ++lemp->nconflict_sr;
+      ++*pnSR;
     }else if( spx->prec>spy->prec ){    /* higher precedence wins */
       apy->type = RD_RESOLVED;
     }else if( spx->prec<spy->prec ){
@@ -1329,7 +2340,7 @@ static int resolve_conflict(
     spy->prec<0 || spx->prec==spy->prec ){
       apy->type = RRCONFLICT;
       errcnt++;
-      ++lemp->nconflict_rr;
+      ++*pnRR;
     }else if( spx->prec>spy->prec ){
       apy->type = RD_RESOLVED;
     }else if( spx->prec<spy->prec ){
@@ -1354,6 +2365,101 @@ static int resolve_conflict(
   }
   return errcnt;
 }
+
+/* Arguments to policy_work() */
+struct policy_arg {
+  struct action **aList;   /* A copy of the action list of every state */
+  int iPolicy;             /* Index of the policy in lemp->aPolicy[] */
+};
+
+/* Resolve the copied actions of states iFirst..iLast-1 under one policy
+** and count the outcome into every state's aPolicyCnt[] */
+static void policy_work(
+  struct lemon *lemp,
+  void *pArg,
+  int iChunk,
+  int iFirst,
+  int iLast
+){
+  struct policy_arg *p = (struct policy_arg*)pArg;
+  struct conflict_count *pCnt;
+  struct action *ap, *nap;
+  int i;
+  (void)iChunk;
+  for(i=iFirst; i<iLast; i++){
+    pCnt = &lemp->sorted[i]->aPolicyCnt[p->iPolicy];
+    p->aList[i] = Action_sort(p->aList[i]);
+    for(ap=p->aList[i]; ap && ap->next; ap=ap->next){
+      for(nap=ap->next; nap && nap->sp==ap->sp; nap=nap->next){
+        pCnt->n += resolve_conflict(ap,nap,&pCnt->nSR,&pCnt->nRR);
+      }
+    }
+    for(ap=p->aList[i]; ap; ap=ap->next){
+      if( ap->type==SH_RESOLVED || ap->type==RD_RESOLVED
+       || ap->type==ERROR ) pCnt->nPrec++;
+    }
+  }
+}
+
+/* Count the conflicts that every -P precedence policy leaves in the
+** automaton.  The states and their unresolved actions are the same for
+** all policies, so each one only resolves a copy of the action lists
+** with the rule precedences it implies.  The real action lists, and the
+** rule precedences of the command line, are left as they were.
+*/
+void FindPolicyConflicts(struct lemon *lemp)
+{
+  struct policy_arg x;
+  struct action *aCopy, *ap;
+  struct symbol **aPrecsym;
+  struct rule *rp;
+  int i, j, k, nAction;
+
+  lemp->aPolicyCnt = (struct conflict_count*)calloc(
+                lemp->nstate*lemp->nPolicy, sizeof(lemp->aPolicyCnt[0]));
+  aPrecsym = (struct symbol**)calloc(lemp->nrule+1, sizeof(aPrecsym[0]));
+  x.aList = (struct action**)calloc(lemp->nstate+1, sizeof(x.aList[0]));
+  MemoryCheck(lemp->aPolicyCnt);
+  MemoryCheck(aPrecsym);
+  MemoryCheck(x.aList);
+  for(nAction=i=0; i<lemp->nstate; i++){
+    lemp->sorted[i]->aPolicyCnt = &lemp->aPolicyCnt[i*lemp->nPolicy];
+    for(ap=lemp->sorted[i]->ap; ap; ap=ap->next) nAction++;
+  }
+  aCopy = (struct action*)malloc( (nAction+1)*sizeof(aCopy[0]) );
+  MemoryCheck(aCopy);
+  for(i=0, rp=lemp->rule; rp; rp=rp->next) aPrecsym[i++] = rp->precsym;
+
+  for(k=0; k<lemp->nPolicy; k++){
+    /* Give every rule the precedence this policy implies */
+    for(i=0, rp=lemp->rule; rp; rp=rp->next, i++){
+      if( lemp->aPolicy[k]==PREC_NONE ){
+        rp->precsym = 0;
+      }else if( rp->precsym_decl ){
+        rp->precsym = aPrecsym[i];
+      }else{
+        rp->precsym = rule_rhs_precsym(rp, lemp->aPolicy[k]==PREC_YACC);
+      }
+    }
+
+    /* Copy the unresolved action lists and resolve the copies */
+    for(i=j=0; i<lemp->nstate; i++){
+      x.aList[i] = 0;
+      for(ap=lemp->sorted[i]->ap; ap; ap=ap->next){
+        aCopy[j] = *ap;
+        aCopy[j].next = x.aList[i];
+        x.aList[i] = &aCopy[j++];
+      }
+    }
+    x.iPolicy = k;
+    Parallel_for(lemp, lemp->nstate, policy_work, &x);
+  }
+
+  for(i=0, rp=lemp->rule; rp; rp=rp->next) rp->precsym = aPrecsym[i++];
+  free(aCopy);
+  free(x.aList);
+  free(aPrecsym);
+}
 /********************* From the file "configlist.c" *************************/
 /*
 ** Routines to processing a configuration list and building a state
@@ -1362,7 +2468,15 @@ static int resolve_conflict(
 
 /* Return a pointer to a new configuration */
 PRIVATE struct config *newconfig(struct lemon *lemp){
-  return (struct config*)calloc(1, sizeof(struct config));
+  struct config *newcfg;
+  if( lemp->freelist ){
+    newcfg = lemp->freelist;
+    lemp->freelist = newcfg->next;
+    memset(newcfg, 0, sizeof(*newcfg));
+  }else{
+    newcfg = (struct config*)Arena_alloc(lemp, sizeof(struct config));
+  }
+  return newcfg;
 }
 
 /* The configuration "old" is no longer used */
@@ -1408,7 +2522,7 @@ struct config *Configlist_add(
     cfp = newconfig(lemp);
     cfp->rp = rp;
     cfp->dot = dot;
-    cfp->fws = SetNew(lemp);
+    cfp->fws = lemp->laEngine==LA_PLINK ? SetNew(lemp) : 0;
     cfp->stp = 0;
     cfp->fplp = cfp->bplp = 0;
     cfp->next = 0;
@@ -1434,7 +2548,7 @@ struct config *Configlist_addbasis(struct lemon *lemp, struct rule *rp, int dot)
     cfp = newconfig(lemp);
     cfp->rp = rp;
     cfp->dot = dot;
-    cfp->fws = SetNew(lemp);
+    cfp->fws = lemp->laEngine==LA_PLINK ? SetNew(lemp) : 0;
     cfp->stp = 0;
     cfp->fplp = cfp->bplp = 0;
     cfp->next = 0;
@@ -1470,6 +2584,7 @@ void Configlist_closure(struct lemon *lemp)
       }
       for(newrp=sp->rule; newrp; newrp=newrp->nextlhs){
         newcfp = Configlist_add(lemp, newrp,0);
+        if( lemp->laEngine!=LA_PLINK ) continue;  /* No follow-sets yet */
         for(i=dot+1; i<rp->nrhs; i++){
           xsp = rp->rhs[i];
           if( xsp->type==TERMINAL ){
@@ -1537,7 +2652,7 @@ void Configlist_eat(struct lemon *lemp, struct config *cfp)
     nextcfp = cfp->next;
     assert( cfp->fplp==0 );
     assert( cfp->bplp==0 );
-    if( cfp->fws ) SetFree(cfp->fws);
+    if( cfp->fws ) SetFree(lemp, cfp->fws);
     deleteconfig(lemp, cfp);
   }
   return;
@@ -1607,6 +2722,79 @@ static void handle_d_option(struct lemon *lem, char *z){
   lemon_strcpy(lem->outputDir, z);
 }
 
+/* Remember the number of threads requested by -j
+*/
+static void handle_j_option(struct lemon *lem, char *z){
+  lem->nthread = atoi(z);
+  if( lem->nthread<1 ){
+    fprintf(stderr,"the -j option needs a positive number of threads\n");
+    exit(1);
+  }
+}
+
+/* Choose how the lookaheads are computed: -Lplink or -Ldigraph
+*/
+static void handle_L_option(struct lemon *lem, char *z){
+  if( strcmp(z,"plink")==0 ){
+    lem->laEngine = LA_PLINK;
+  }else if( strcmp(z,"digraph")==0 ){
+    lem->laEngine = LA_DIGRAPH;
+  }else{
+    fprintf(stderr,"unknown lookahead method \"%s\" for -L.  "
+                   "Use \"plink\" or \"digraph\".\n", z);
+    exit(1);
+  }
+}
+
+static void handle_P_option(struct lemon *lem, char *z){
+  static const struct {
+    const char *zName;
+    enum e_precpolicy e;
+  } aName[] = {
+    { "lemon", PREC_LEMON },
+    { "yacc",  PREC_YACC  },
+    { "none",  PREC_NONE  },
+  };
+  int i, j, n;
+  while( *z ){
+    n = (int)strcspn(z, ",");
+    if( n==3 && strncmp(z, "all", 3)==0 ){
+      lem->nPolicy = 0;
+      for(i=0; i<MX_POLICY; i++) lem->aPolicy[lem->nPolicy++] = aName[i].e;
+    }else{
+      for(i=0; i<MX_POLICY; i++){
+        if( (int)strlen(aName[i].zName)==n
+         && strncmp(z, aName[i].zName, n)==0 ) break;
+      }
+      if( i>=MX_POLICY ){
+        fprintf(stderr,"unknown precedence policy \"%.*s\" for -P.  "
+                       "Use \"lemon\", \"yacc\", \"none\" or \"all\".\n",
+                n, z);
+        exit(1);
+      }
+      for(j=0; j<lem->nPolicy && lem->aPolicy[j]!=aName[i].e; j++){}
+      if( j==lem->nPolicy ) lem->aPolicy[lem->nPolicy++] = aName[i].e;
+    }
+    z += n;
+    if( *z==',' ) z++;
+  }
+}
+
+/* Code the automaton as switch statements instead of tables, as long
+** as it has no more than the given number of actions: -k or -k<N>
+*/
+static void handle_k_option(struct lemon *lem, char *z){
+  lem->mxCoded = *z ? atoi(z) : 20000;
+  if( lem->mxCoded<1 ){
+    fprintf(stderr,"the -k option needs a positive number of actions\n");
+    exit(1);
+  }
+}
+
+static void handle_G_option(struct lemon *lem, char *z){
+  lem->zProfile = z;
+}
+
 static void handle_T_option(struct lemon *lem, char *z){
   lem->user_templatename = (char *) malloc( lemonStrlen(z)+1 );
   if( lem->user_templatename==0 ){
@@ -1690,6 +2878,8 @@ int main(int argc, char **argv){
   int noResort = 0;
   int sqlFlag = 0;
   int printPP = 0;
+  int cacheflag = 0;
+  struct cache_key key;
 
   struct lemon lem;
   memset(&lem, 0, sizeof(lem));
@@ -1699,21 +2889,35 @@ int main(int argc, char **argv){
   struct s_options options[] = {
     {OPT_FLAG, "b", (char*)&basisflag, "Print only the basis in report."},
     {OPT_FLAG, "c", (char*)&compress, "Don't compress the action table."},
+    {OPT_FLAG, "C", (char*)&cacheflag,
+                    "Reuse or save the automaton in the *.lcache file."},
     {OPT_FSTR, "d", (char*)&handle_d_option, "Output directory.  Default '.'"},
     {OPT_FSTR, "D", (char*)handle_D_option, "Define an %ifdef macro."},
     {OPT_FLAG, "E", (char*)&printPP, "Print input file after preprocessing."},
+    {OPT_FLAG, "F", (char*)&lem.resolveFallback,
+                      "Resolve fallbacks and the wildcard into the tables."},
     {OPT_FSTR, "f", 0, "Ignored.  (Placeholder for -f compiler options.)"},
     {OPT_FLAG, "g", (char*)&rpflag, "Print grammar without actions."},
+    {OPT_FSTR, "G", (char*)handle_G_option,
+                    "Order states and tables by a YYPROFILE profile."},
     {OPT_FLAG, "y", (char*)&rpyflag, "Print yacc grammar without actions."},
     {OPT_FLAG, "Y", (char*)&rpyflag2, "Print yacc grammar without actions with full precedences."},
     {OPT_FLAG, "z", (char*)&lem.yaccPrec, "Use yacc rule precedence"},
     {OPT_FLAG, "u", (char*)&lem.ignorePrec, "Ignore all precedences"},
     {OPT_FSTR, "I", 0, "Ignored.  (Placeholder for '-I' compiler options.)"},
+    {OPT_FSTR, "j", (char*)handle_j_option,
+                    "Number of threads to use.  Default 1."},
+    {OPT_FSTR, "k", (char*)handle_k_option,
+                    "Code the automaton as switches, up to N actions (20000)."},
+    {OPT_FSTR, "L", (char*)handle_L_option,
+                    "Lookahead method: plink (default) or digraph."},
     {OPT_FLAG, "m", (char*)&mhflag, "Output a makeheaders compatible file."},
     {OPT_FLAG, "l", (char*)&nolinenosflag, "Do not print #line statements."},
     {OPT_FSTR, "O", 0, "Ignored.  (Placeholder for '-O' compiler options.)"},
     {OPT_FLAG, "p", (char*)&lem.showPrecedenceConflict,
                     "Show conflicts resolved by precedence rules"},
+    {OPT_FSTR, "P", (char*)handle_P_option,
+                    "Count conflicts under the precedence policies lemon,yacc,none."},
     {OPT_FLAG, "q", (char*)&quiet, "(Quiet) Don't print the report file."},
     {OPT_FLAG, "r", (char*)&noResort, "Do not sort or renumber states"},
     {OPT_FLAG, "s", (char*)&statistics,
@@ -1722,6 +2926,8 @@ int main(int argc, char **argv){
                     "Generate the *.sql file describing the parser tables."},
     {OPT_FLAG, "x", (char*)&version, "Print the version number."},
     {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
+    {OPT_FLAG, "V", (char*)&lem.splitStack,
+                      "Keep semantic values apart from the parser states."},
     {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"},
     {OPT_FLAG,0,0,0}
   };
@@ -1738,6 +2944,11 @@ int main(int argc, char **argv){
     fprintf(stderr,"Exactly one filename argument is required.\n");
     exit(1);
   }
+  if( lem.nPolicy>0 && lem.ignorePrec ){
+    fprintf(stderr,"The -P option cannot be used with -u, which ignores "
+                   "all precedences.\n");
+    exit(1);
+  }
 
   /* Initialize the machine */
   Strsafe_init(&lem);
@@ -1815,32 +3026,58 @@ int main(int argc, char **argv){
     ** nonterminal */
     FindFirstSets(&lem);
 
-    /* Compute all LR(0) states.  Also record follow-set propagation
-    ** links so that the follow-set can be computed later */
-    lem.nstate = 0;
-    FindStates(&lem);
-    lem.sorted = State_arrayof(&lem);
+    /* Reuse the automaton of an earlier run on the same grammar if the
+    ** -C option is given and a matching *.lcache file exists */
+    memset(&key, 0, sizeof(key));
+    if( cacheflag ) Cache_key(&lem, &key, compress, noResort);
+    if( cacheflag==0 || lem.nPolicy>0 || lem.zProfile
+     || Cache_load(&lem, &key)==0 ){
+      int nErr = lem.errorcnt;
+
+      /* Compute all LR(0) states.  Also record follow-set propagation
+      ** links so that the follow-set can be computed later */
+      lem.nstate = 0;
+      FindStates(&lem);
+      lem.sorted = State_arrayof(&lem);
+
+      /* Compute the follow set of every reducible configuration */
+      if( lem.laEngine==LA_DIGRAPH ){
+        FindGotoFollowSets(&lem);
+      }else{
+        /* Tie up loose ends on the propagation links */
+        FindLinks(&lem);
+        FindFollowSets(&lem);
+      }
 
-    /* Tie up loose ends on the propagation links */
-    FindLinks(&lem);
+      /* Compute the action tables */
+      FindActions(&lem);
 
-    /* Compute the follow set of every reducible configuration */
-    FindFollowSets(&lem);
+      /* Compress the action tables */
+      if( compress==0 ) CompressTables(&lem);
 
-    /* Compute the action tables */
-    FindActions(&lem);
+      /* Reorder and renumber the states so that states with fewer choices
+      ** occur at the end.  This is an optimization that helps make the
+      ** generated parser tables smaller. */
+      if( noResort==0 ) ResortStates(&lem);
 
-    /* Compress the action tables */
-    if( compress==0 ) CompressTables(&lem);
+      /* Remember the automaton, unless building it raised errors that a
+      ** later run would then have to repeat */
+      if( cacheflag && lem.errorcnt==nErr ) Cache_save(&lem, &key);
 
-    /* Reorder and renumber the states so that states with fewer choices
-    ** occur at the end.  This is an optimization that helps make the
-    ** generated parser tables smaller. */
-    if( noResort==0 ) ResortStates(&lem);
+      /* Move the states that the -G profile found busiest to the front.
+      ** The profile numbers states as ResortStates() does, so this comes
+      ** after it, and after the cache has the unprofiled automaton. */
+      if( lem.zProfile && noResort==0 ) ProfileStates(&lem);
+    }
+    free(key.z);
 
     /* Generate a report of the parser generated.  (the "y.output" file) */
     if( !quiet ) ReportOutput(&lem);
 
+    /* Add the actions that fallbacks and the wildcard lead to into the
+    ** tables, after the report, which shows the automaton itself */
+    if( lem.resolveFallback ) ResolveFallbacks(&lem);
+
     /* Generate the source code for the parser */
     ReportTable(&lem, mhflag);
 
@@ -1865,6 +3102,13 @@ int main(int argc, char **argv){
     stats_line("lookahead table entries", lem.nlookaheadtab);
     stats_line("total table size (bytes)", lem.tablesize);
   }
+  if( lem.nPolicy ) ReportPolicies(&lem);
+  if( lem.resolveFallback ){
+    printf("Resolved %d fallback and %d wildcard lookups into the tables.\n",
+           lem.nFallbackResolved, lem.nWildcardResolved);
+    printf("The tables now take %d bytes (%d action entries).\n",
+           lem.tablesize, lem.nactiontab);
+  }
   int nexpect = lem.expect ? atoi(lem.expect) : 0;
 
   if( lem.nconflict != nexpect ){
@@ -1875,14 +3119,16 @@ int main(int argc, char **argv){
   exitcode = ((lem.errorcnt > 0) || (lem.nconflict != nexpect)) ? 1 : 0;
 
   /*Cleanup*/
-  if(lem.plink_freelist) {
-    //free(lem.plink_freelist);
-    Configtable_deinit(&lem);
-    State_deinit(&lem);
-    Symbol_deinit(&lem);
-    Strsafe_deinit(&lem);
-    free(lem.outname);
-  }
+  Configtable_deinit(&lem);
+  State_deinit(&lem);
+  Symbol_deinit(&lem);
+  Strsafe_deinit(&lem);
+  Arena_reset(&lem);
+  free(lem.sorted);
+  free(lem.symbols);
+  free(lem.outname);
+  free(lem.zStateReport);
+  free(lem.aPolicyCnt);
 
   exit(exitcode);
   return (exitcode);
@@ -2292,6 +3538,15 @@ void OptPrint(struct lemon *lem){
 */
 
 /* The state of the parser */
+/* A range of the input file removed by the preprocessor.  Each range
+** starts at the beginning of a line and ends at the end of a line, just
+** before the newline.  The scanner reads it as white space. */
+struct pp_range {
+  size_t iStart;             /* Offset of the first byte */
+  size_t iEnd;               /* Offset of the byte following the range */
+  int nNewline;              /* Newlines inside the range */
+};
+
 enum e_state {
   INITIALIZE,
   WAITING_FOR_DECL_OR_RULE,
@@ -2323,6 +3578,12 @@ struct pstate {
   int errorcnt;         /* Number of errors so far */
   char *tokenstart;     /* Text of current token */
   struct lemon *gp;     /* Global state vector */
+  const char *zInput;        /* Text of the input file (read-only) */
+  struct pp_range *aExcl;    /* Text removed by %ifdef and friends */
+  int nExcl;                 /* Number of entries in aExcl[] */
+  int iExcl;                 /* Next entry of aExcl[] the scanner reaches */
+  char *zToken;              /* Buffer holding a copy of the current token */
+  size_t nTokenAlloc;        /* Bytes allocated for zToken */
   enum e_state state;        /* The state of the parser */
   struct symbol *fallback;   /* The fallback token */
   struct symbol *tkclass;    /* Token class symbol */
@@ -2990,38 +4251,57 @@ pp_syntax_error:
   }
 }
 
+/* Append to psp->aExcl[] the range iStart..iEnd-1 of the input.
+*/
+static void pp_exclude(struct pstate *psp, size_t iStart, size_t iEnd){
+  struct pp_range *p;
+  size_t i;
+  if( (psp->nExcl & (psp->nExcl-1))==0 ){
+    int nNew = psp->nExcl ? psp->nExcl*2 : 16;
+    psp->aExcl = (struct pp_range*)realloc(psp->aExcl, nNew*sizeof(p[0]));
+    MemoryCheck(psp->aExcl);
+  }
+  p = &psp->aExcl[psp->nExcl++];
+  p->iStart = iStart;
+  p->iEnd = iEnd;
+  p->nNewline = 0;
+  for(i=iStart; i<iEnd; i++){
+    if( psp->zInput[i]=='\n' ) p->nNewline++;
+  }
+}
+
 /* Run the preprocessor over the input file text.  The global variables
 ** azDefine[0] through azDefine[nDefine-1] contains the names of all defined
-** macros.  This routine looks for "%ifdef" and "%ifndef" and "%endif" and
-** comments them out.  Text in between is also commented out as appropriate.
+** macros.  This routine looks for "%ifdef" and "%ifndef" and "%endif".
+** The input is never modified: the directives, and the text they exclude,
+** are recorded in psp->aExcl[] in increasing order for the scanner to skip.
 */
-static void preprocess_input(struct lemon *lem, char *z){
-  int i, j, k;
+static void preprocess_input(struct lemon *lem, struct pstate *psp){
+  const char *z = psp->zInput;
+  size_t i, j, start = 0;
   int exclude = 0;
-  int start = 0;
   int lineno = 1;
   int start_lineno = 1;
   for(i=0; z[i]; i++){
     if( z[i]=='\n' ) lineno++;
     if( z[i]!='%' || (i>0 && z[i-1]!='\n') ) continue;
+    for(j=i; z[j] && z[j]!='\n'; j++){}   /* j is the end of the line */
     if( strncmp(&z[i],"%endif",6)==0 && ISSPACE(z[i+6]) ){
       if( exclude ){
         exclude--;
-        if( exclude==0 ){
-          for(j=start; j<i; j++) if( z[j]!='\n' ) z[j] = ' ';
-        }
+        if( exclude==0 ) pp_exclude(psp, start, j);
+      }else{
+        pp_exclude(psp, i, j);
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
     }else if( strncmp(&z[i],"%else",5)==0 && ISSPACE(z[i+5]) ){
       if( exclude==1){
         exclude = 0;
-        for(j=start; j<i; j++) if( z[j]!='\n' ) z[j] = ' ';
+        pp_exclude(psp, start, j);
       }else if( exclude==0 ){
         exclude = 1;
         start = i;
         start_lineno = lineno;
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
     }else if( strncmp(&z[i],"%ifdef ",7)==0
           || strncmp(&z[i],"%if ",4)==0
           || strncmp(&z[i],"%ifndef ",8)==0 ){
@@ -3029,22 +4309,24 @@ static void preprocess_input(struct lemon *lem, char *z){
         exclude++;
       }else{
         int isNot;
-        int iBool;
-        for(j=i; z[j] && !ISSPACE(z[j]); j++){}
-        iBool = j;
-        isNot = (j==i+7);
-        while( z[j] && z[j]!='\n' ){ j++; }
-        k = z[j];
-        z[j] = 0;
-        exclude = eval_preprocessor_boolean(lem, &z[iBool], lineno);
-        z[j] = k;
+        size_t iBool;
+        char *zExpr;
+        for(iBool=i; !ISSPACE(z[iBool]); iBool++){}
+        isNot = (iBool==i+7);
+        zExpr = (char*)malloc( j-iBool+1 );
+        MemoryCheck(zExpr);
+        memcpy(zExpr, &z[iBool], j-iBool);
+        zExpr[j-iBool] = 0;
+        exclude = eval_preprocessor_boolean(lem, zExpr, lineno);
+        free(zExpr);
         if( !isNot ) exclude = !exclude;
         if( exclude ){
           start = i;
           start_lineno = lineno;
+        }else{
+          pp_exclude(psp, i, j);
         }
       }
-      for(j=i; z[j] && z[j]!='\n'; j++) z[j] = ' ';
     }
   }
   if( exclude ){
@@ -3053,21 +4335,141 @@ static void preprocess_input(struct lemon *lem, char *z){
   }
 }
 
-/* In spite of its name, this function is really a scanner.  It read
-** in the entire input file (all at once) then tokenizes it.  Each
-** token is passed to the function "parseonetoken" which builds all
+/* The scanner is on the newline at cp.  If the line that follows was
+** removed by the preprocessor, skip it: count its newlines and return a
+** pointer to its last byte, so that the next step of the scanner lands
+** on the newline at its end.  Otherwise return cp.
+*/
+static const char *pp_skip(struct pstate *psp, const char *cp, int *pLineno){
+  struct pp_range *p;
+  if( psp->iExcl>=psp->nExcl ) return cp;
+  p = &psp->aExcl[psp->iExcl];
+  if( cp+1!=psp->zInput+p->iStart ) return cp;
+  psp->iExcl++;
+  *pLineno += p->nNewline;
+  return psp->zInput + p->iEnd - 1;
+}
+
+/* Copy the token that starts at psp->zInput[iStart] and ends just
+** before zEnd into psp->zToken, with a zero terminator.  Ranges removed
+** by the preprocessor, all of them from aExcl[iExcl] up to the current
+** one, read as white space.  Point psp->tokenstart at the copy.
+*/
+static void token_copy(
+  struct pstate *psp,
+  const char *zStart,
+  const char *zEnd,
+  int iExcl
+){
+  size_t n = zEnd - zStart;
+  size_t iStart = zStart - psp->zInput;
+  size_t i;
+  if( n+1>psp->nTokenAlloc ){
+    psp->nTokenAlloc = n+1 > 2*psp->nTokenAlloc ? n+1 : 2*psp->nTokenAlloc;
+    psp->zToken = (char*)realloc(psp->zToken, psp->nTokenAlloc);
+    MemoryCheck(psp->zToken);
+  }
+  memcpy(psp->zToken, zStart, n);
+  psp->zToken[n] = 0;
+  for(; iExcl<psp->iExcl; iExcl++){
+    struct pp_range *p = &psp->aExcl[iExcl];
+    for(i=p->iStart; i<p->iEnd; i++){
+      if( psp->zToken[i-iStart]!='\n' ) psp->zToken[i-iStart] = ' ';
+    }
+  }
+  psp->tokenstart = psp->zToken;
+}
+
+/* Read the file zName into memory, read-only and followed by at least
+** one zero byte.  Return a pointer to the text and write its size into
+** *pn, or return NULL if the file cannot be read.  Release the text with
+** input_free().
+**
+** Where mmap() is available the file is mapped rather than copied, and
+** there is no limit on its size.  A private anonymous mapping one byte
+** longer than the file is reserved first and the file is mapped over the
+** start of it, so the byte after the file reads as zero even when the
+** file size is a multiple of the page size.  Anything that cannot be
+** mapped, such as a pipe, is read into a growing buffer.
+*/
+static const char *input_read(const char *zName, size_t *pn, size_t *pnMap){
+  FILE *fp;
+  char *z = 0;
+  size_t n = 0, nAlloc = 0, got;
+
+  *pnMap = 0;
+#ifdef LEMON_MMAP
+  {
+    int fd = open(zName, O_RDONLY);
+    struct stat st;
+    if( fd<0 ) return 0;
+    if( fstat(fd, &st)==0 && S_ISREG(st.st_mode) ){
+      size_t pgsz = (size_t)sysconf(_SC_PAGESIZE);
+      size_t nMap = ((size_t)st.st_size + pgsz) / pgsz * pgsz;
+      void *pBase = mmap(0, nMap, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      if( pBase!=MAP_FAILED ){
+        if( st.st_size==0
+         || mmap(pBase, st.st_size, PROT_READ, MAP_PRIVATE|MAP_FIXED, fd, 0)
+                ==pBase ){
+          close(fd);
+          *pn = st.st_size;
+          *pnMap = nMap;
+          return (const char*)pBase;
+        }
+        munmap(pBase, nMap);
+      }
+    }
+    close(fd);
+  }
+#endif
+  fp = fopen(zName,"rb");
+  if( fp==0 ) return 0;
+  do{
+    if( n+1>=nAlloc ){
+      nAlloc = nAlloc ? nAlloc*2 : 65536;
+      z = (char*)realloc(z, nAlloc);
+      MemoryCheck(z);
+    }
+    got = fread(&z[n], 1, nAlloc-n-1, fp);
+    n += got;
+  }while( got>0 );
+  if( ferror(fp) ){
+    free(z);
+    fclose(fp);
+    return 0;
+  }
+  fclose(fp);
+  z[n] = 0;
+  *pn = n;
+  return z;
+}
+
+/* Release text obtained from input_read() */
+static void input_free(const char *z, size_t nMap){
+#ifdef LEMON_MMAP
+  if( nMap ){
+    munmap((void*)z, nMap);
+    return;
+  }
+#endif
+  free((char*)z);
+}
+
+/* In spite of its name, this function is really a scanner.  It maps
+** the entire input file into memory (all at once) then tokenizes it.
+** Each token is passed to the function "parseonetoken" which builds all
 ** the appropriate data structures in the global state vector "gp".
 */
 void Parse(struct lemon *gp)
 {
   struct pstate ps;
-  FILE *fp;
-  char *filebuf;
-  unsigned int filesize;
+  const char *filebuf;
+  size_t filesize, nMap;
   int lineno;
   int c;
-  char *cp, *nextcp;
+  const char *cp, *nextcp;
   int startline = 0;
+  int iExcl;
 
   memset(&ps, '\0', sizeof(ps));
   ps.gp = gp;
@@ -3075,46 +4477,47 @@ void Parse(struct lemon *gp)
   ps.errorcnt = 0;
   ps.state = INITIALIZE;
 
-  /* Begin by reading the input file */
-  fp = fopen(ps.filename,"rb");
-  if( fp==0 ){
+  /* Begin by mapping the input file */
+  filebuf = input_read(ps.filename, &filesize, &nMap);
+  if( filebuf==0 ){
     ErrorMsg(ps.filename,0,"Can't open this file for reading.");
     gp->errorcnt++;
     return;
   }
-  fseek(fp,0,2);
-  filesize = ftell(fp);
-  rewind(fp);
-  filebuf = (char *)malloc( filesize+1 );
-  if( filesize>100000000 || filebuf==0 ){
-    ErrorMsg(ps.filename,0,"Input file too large.");
-    free(filebuf);
-    gp->errorcnt++;
-    fclose(fp);
-    return;
-  }
-  if( fread(filebuf,1,filesize,fp)!=filesize ){
-    ErrorMsg(ps.filename,0,"Can't read in all %d bytes of this file.",
-      filesize);
-    free(filebuf);
-    gp->errorcnt++;
-    fclose(fp);
-    return;
-  }
-  fclose(fp);
-  filebuf[filesize] = 0;
+  ps.zInput = filebuf;
 
   /* Make an initial pass through the file to handle %ifdef and %ifndef */
-  preprocess_input(gp, filebuf);
+  preprocess_input(gp, &ps);
   if( gp->printPreprocessed ){
-    printf("%s\n", filebuf);
+    size_t i = 0;
+    for(iExcl=0; iExcl<ps.nExcl; iExcl++){
+      struct pp_range *p = &ps.aExcl[iExcl];
+      fwrite(&filebuf[i], 1, p->iStart-i, stdout);
+      for(i=p->iStart; i<p->iEnd; i++){
+        putchar(filebuf[i]=='\n' ? '\n' : ' ');
+      }
+    }
+    printf("%s\n", &filebuf[i]);
+    free(ps.aExcl);
+    input_free(filebuf, nMap);
     return;
   }
 
-  /* Now scan the text of the input file */
+  /* Now scan the text of the input file.  A range removed by the
+  ** preprocessor always starts a line, so the scanner only has to look
+  ** for one after a newline (or at the very start of the file). */
   lineno = 1;
-  for(cp=filebuf; (c= *cp)!=0; ){
-    if( c=='\n' ) lineno++;              /* Keep track of the line number */
+  cp = filebuf;
+  if( ps.nExcl>0 && ps.aExcl[0].iStart==0 ){
+    lineno += ps.aExcl[0].nNewline;
+    cp = filebuf + ps.aExcl[0].iEnd;
+    ps.iExcl = 1;
+  }
+  for(; (c= *cp)!=0; ){
+    if( c=='\n' ){                       /* Keep track of the line number */
+      lineno++;
+      cp = pp_skip(&ps, cp, &lineno);
+    }
     if( ISSPACE(c) ){ cp++; continue; }  /* Skip all white space */
     if( c=='/' && cp[1]=='/' ){          /* Skip C++ style comments */
       cp+=2;
@@ -3125,18 +4528,25 @@ void Parse(struct lemon *gp)
       cp+=2;
       if( (*cp)=='/' ) cp++;
       while( (c= *cp)!=0 && (c!='/' || cp[-1]!='*') ){
-        if( c=='\n' ) lineno++;
+        if( c=='\n' ){
+          lineno++;
+          cp = pp_skip(&ps, cp, &lineno);
+        }
         cp++;
       }
       if( c ) cp++;
       continue;
     }
-    ps.tokenstart = cp;                /* Mark the beginning of the token */
+    iExcl = ps.iExcl;                  /* Ranges skipped inside the token */
+    ps.tokenstart = (char*)cp;         /* Mark the beginning of the token */
     ps.tokenlineno = lineno;           /* Linenumber on which token begins */
     if( c=='\"' ){                     /* String literals */
       cp++;
       while( (c= *cp)!=0 && c!='\"' ){
-        if( c=='\n' ) lineno++;
+        if( c=='\n' ){
+          lineno++;
+          cp = pp_skip(&ps, cp, &lineno);
+        }
         cp++;
       }
       if( c==0 ){
@@ -3152,7 +4562,10 @@ void Parse(struct lemon *gp)
       int level;
       cp++;
       for(level=1; (c= *cp)!=0 && (level>1 || c!='}'); cp++){
-        if( c=='\n' ) lineno++;
+        if( c=='\n' ){
+          lineno++;
+          cp = pp_skip(&ps, cp, &lineno);
+        }
         else if( c=='{' ) level++;
         else if( c=='}' ) level--;
         else if( c=='/' && cp[1]=='*' ){  /* Skip comments */
@@ -3160,20 +4573,29 @@ void Parse(struct lemon *gp)
           cp = &cp[2];
           prevc = 0;
           while( (c= *cp)!=0 && (c!='/' || prevc!='*') ){
-            if( c=='\n' ) lineno++;
+            if( c=='\n' ){
+              lineno++;
+              cp = pp_skip(&ps, cp, &lineno);
+            }
             prevc = c;
             cp++;
           }
         }else if( c=='/' && cp[1]=='/' ){  /* Skip C++ style comments too */
           cp = &cp[2];
           while( (c= *cp)!=0 && c!='\n' ) cp++;
-          if( c ) lineno++;
+          if( c ){
+            lineno++;
+            cp = pp_skip(&ps, cp, &lineno);
+          }
         }else if( c=='\'' || c=='\"' ){    /* String a character literals */
           int startchar, prevc;
           startchar = c;
           prevc = 0;
           for(cp++; (c= *cp)!=0 && (c!=startchar || prevc=='\\'); cp++){
-            if( c=='\n' ) lineno++;
+            if( c=='\n' ){
+              lineno++;
+              cp = pp_skip(&ps, cp, &lineno);
+            }
             if( prevc=='\\' ) prevc = 0;
             else              prevc = c;
           }
@@ -3202,13 +4624,13 @@ void Parse(struct lemon *gp)
       cp++;
       nextcp = cp;
     }
-    c = *cp;
-    *cp = 0;                        /* Null terminate the token */
+    token_copy(&ps, ps.tokenstart, cp, iExcl);  /* Null terminate a copy */
     parseonetoken(gp, &ps);             /* Parse the token */
-    *cp = (char)c;                  /* Restore the buffer */
     cp = nextcp;
   }
-  free(filebuf);                    /* Release the buffer after parsing */
+  input_free(filebuf, nMap);        /* Release the input after parsing */
+  free(ps.aExcl);
+  free(ps.zToken);
   gp->rule = ps.firstrule;
   gp->errorcnt = ps.errorcnt;
   gp->preccounter = ps.preccounter;
@@ -3224,16 +4646,7 @@ struct plink *Plink_new(struct lemon *lemp){
   struct plink *newlink;
 
   if( lemp->plink_freelist==0 ){
-    int i;
-    int amt = 100;
-    lemp->plink_freelist = (struct plink *)calloc( amt, sizeof(struct plink) );
-    if( lemp->plink_freelist==0 ){
-      fprintf(stderr,
-      "Unable to allocate memory for a new follow-set propagation link.\n");
-      exit(1);
-    }
-    for(i=0; i<amt-1; i++) lemp->plink_freelist[i].next = &lemp->plink_freelist[i+1];
-    lemp->plink_freelist[amt-1].next = 0;
+    return (struct plink *)Arena_alloc(lemp, sizeof(struct plink));
   }
   newlink = lemp->plink_freelist;
   lemp->plink_freelist = lemp->plink_freelist->next;
@@ -3675,7 +5088,7 @@ void ConfigPrint(FILE *fp, struct config *cfp){
 /* Print a set */
 PRIVATE void SetPrint(out,set,lemp)
 FILE *out;
-char *set;
+SetWord *set;
 struct lemon *lemp;
 {
   int i;
@@ -3775,18 +5188,14 @@ int PrintAction(
   return result;
 }
 
-/* Generate the "*.out" log file */
-void ReportOutput(struct lemon *lemp)
+/* Write the description of every state into the "*.out" log file */
+PRIVATE void ReportStates(struct lemon *lemp, FILE *fp)
 {
-  int i, n;
+  int i;
   struct state *stp;
   struct config *cfp;
   struct action *ap;
-  struct rule *rp;
-  FILE *fp;
 
-  fp = file_open(lemp,".out","wb");
-  if( fp==0 ) return;
   for(i=0; i<lemp->nxstate; i++){
     stp = lemp->sorted[i];
     fprintf(fp,"State %d:\n",stp->statenum);
@@ -3816,6 +5225,22 @@ void ReportOutput(struct lemon *lemp)
     }
     fprintf(fp,"\n");
   }
+}
+
+/* Generate the "*.out" log file */
+void ReportOutput(struct lemon *lemp)
+{
+  int i, n;
+  struct rule *rp;
+  FILE *fp;
+
+  fp = file_open(lemp,".out","wb");
+  if( fp==0 ) return;
+  if( lemp->zStateReport ){
+    fwrite(lemp->zStateReport, 1, lemp->nStateReport, fp);
+  }else{
+    ReportStates(lemp, fp);
+  }
   fprintf(fp, "----------------------------------------------------\n");
   fprintf(fp, "Symbols:\n");
   fprintf(fp, "The first-set of non-terminals is shown after the name.\n\n");
@@ -3875,6 +5300,59 @@ void ReportOutput(struct lemon *lemp)
   return;
 }
 
+/* Print the conflicts found under each -P precedence policy side by
+** side on standard output, first in total and then for every state that
+** has a conflict under at least one of the policies.
+*/
+void ReportPolicies(struct lemon *lemp)
+{
+  static const char *azPolicy[] = { "lemon", "yacc", "none" };
+  struct conflict_count sum[MX_POLICY], *pCnt;
+  char zLabel[40], zBuf[40];
+  int i, k, n;
+
+  memset(sum, 0, sizeof(sum));
+  for(i=0; i<lemp->nstate; i++){
+    pCnt = lemp->sorted[i]->aPolicyCnt;
+    for(k=0; k<lemp->nPolicy; k++){
+      sum[k].n += pCnt[k].n;
+      sum[k].nSR += pCnt[k].nSR;
+      sum[k].nRR += pCnt[k].nRR;
+      sum[k].nPrec += pCnt[k].nPrec;
+    }
+  }
+  printf("Precedence policies:\n");
+  printf("  %-35s", "policy");
+  for(k=0; k<lemp->nPolicy; k++) printf(" %7s", azPolicy[lemp->aPolicy[k]]);
+  printf("\n");
+  for(i=0; i<4; i++){
+    static const char *azLabel[] = {
+      "conflicts", "conflicts S/R", "conflicts R/R", "resolved by precedence"
+    };
+    n = lemonStrlen(azLabel[i]);
+    printf("  %s%.*s", azLabel[i], 35-n, "................................");
+    for(k=0; k<lemp->nPolicy; k++){
+      printf(" %7d", i==0 ? sum[k].n : i==1 ? sum[k].nSR :
+                     i==2 ? sum[k].nRR : sum[k].nPrec);
+    }
+    printf("\n");
+  }
+  printf("Conflicts by state (S/R+R/R):\n");
+  for(i=0; i<lemp->nstate; i++){
+    pCnt = lemp->sorted[i]->aPolicyCnt;
+    for(k=0; k<lemp->nPolicy && pCnt[k].n==0; k++){}
+    if( k==lemp->nPolicy ) continue;
+    lemon_sprintf(zLabel, "state %d", lemp->sorted[i]->statenum);
+    n = lemonStrlen(zLabel);
+    printf("  %s%.*s", zLabel, 35-n, "................................");
+    for(k=0; k<lemp->nPolicy; k++){
+      lemon_sprintf(zBuf, "%d+%d", pCnt[k].nSR, pCnt[k].nRR);
+      printf(" %7s", zBuf);
+    }
+    printf("\n");
+  }
+}
+
 /* Search for the file "name" which is in the same directory as
 ** the executable */
 PRIVATE char *pathsearch(char *argv0, char *name, int modemask)
@@ -4220,9 +5698,20 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
   char used[MAXRHS];     /* True for each RHS element which is used */
   char zLhs[50];         /* Convert the LHS symbol into this string */
   char zOvwrt[900];      /* Comment that to allow LHS to overwrite RHS */
+  const char *zValue;    /* Format of a semantic value on the stack */
+  const char *zDestroy;  /* Format of a destructor call for a stack value */
   StrAppendBuffer sa_buf;
   memset(&sa_buf, 0, sizeof(sa_buf));
 
+  /* With -V the values are in their own array, yyvsp[] */
+  if( lemp->splitStack ){
+    zValue = "yyvsp[%d].yy%d";
+    zDestroy = "  yy_destructor(yypParser,%d,&yyvsp[%d]);\n";
+  }else{
+    zValue = "yymsp[%d].minor.yy%d";
+    zDestroy = "  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n";
+  }
+
   for(i=0; i<rp->nrhs; i++) used[i] = 0;
   lhsused = 0;
 
@@ -4245,8 +5734,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
     lhsdirect = 1;
     if( has_destructor(rp->rhs[0],lemp) ){
       append_str(&sa_buf, 0,0,0,0);
-      append_str(&sa_buf, "  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n", 0,
-                 rp->rhs[0]->index,1-rp->nrhs);
+      append_str(&sa_buf, zDestroy, 0, rp->rhs[0]->index,1-rp->nrhs);
       rp->codePrefix = Strsafe(lemp, append_str(&sa_buf, 0,0,0,0));
       rp->noCode = 0;
     }
@@ -4279,7 +5767,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
     }
   }
   if( lhsdirect ){
-    sprintf(zLhs, "yymsp[%d].minor.yy%d",1-rp->nrhs,rp->lhs->dtnum);
+    sprintf(zLhs, zValue,1-rp->nrhs,rp->lhs->dtnum);
   }else{
     rc = 1;
     sprintf(zLhs, "yylhsminor.yy%d",rp->lhs->dtnum);
@@ -4324,7 +5812,7 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
               }else{
                 dtnum = sp->dtnum;
               }
-              append_str(&sa_buf, "yymsp[%d].minor.yy%d",0,i-rp->nrhs+1, dtnum);
+              append_str(&sa_buf, zValue,0,i-rp->nrhs+1, dtnum);
             }
             cp = xp;
             used[i] = 1;
@@ -4381,15 +5869,16 @@ PRIVATE int translate_code(struct lemon *lemp, struct rule *rp){
         lemp->errorcnt++;
       }
     }else if( i>0 && has_destructor(rp->rhs[i],lemp) ){
-      append_str(&sa_buf, "  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n", 0,
-         rp->rhs[i]->index,i-rp->nrhs+1);
+      append_str(&sa_buf, zDestroy, 0, rp->rhs[i]->index,i-rp->nrhs+1);
     }
   }
 
   /* If unable to write LHS values directly into the stack, write the
   ** saved LHS value now. */
   if( lhsdirect==0 ){
-    append_str(&sa_buf, "  yymsp[%d].minor.yy%d = ", 0, 1-rp->nrhs, rp->lhs->dtnum);
+    append_str(&sa_buf, "  ", 0, 0, 0);
+    append_str(&sa_buf, zValue, 0, 1-rp->nrhs, rp->lhs->dtnum);
+    append_str(&sa_buf, " = ", 0, 0, 0);
     append_str(&sa_buf, zLhs, 0, 0, 0);
     append_str(&sa_buf, ";\n", 0, 0, 0);
   }
@@ -4615,15 +6104,20 @@ struct axset {
   int isTkn;           /* True to use tokens.  False for non-terminals */
   int nAction;         /* Number of actions */
   int iOrder;          /* Original order of action sets */
+  unsigned long long nHit; /* Lookups in the -G profile */
+  int nAlign;          /* Slots to align the set to.  0 or 1 for none */
 };
 
 /*
-** Compare to axset structures for sorting purposes
+** Compare to axset structures for sorting purposes.  Empty sets go last.
+** Sets that the -G profile found in use come first, busiest first.
 */
 static int axset_compare(const void *a, const void *b){
   struct axset *p1 = (struct axset*)a;
   struct axset *p2 = (struct axset*)b;
   int c;
+  if( (p1->nAction==0)!=(p2->nAction==0) ) return p1->nAction==0 ? 1 : -1;
+  if( p1->nHit!=p2->nHit ) return p1->nHit<p2->nHit ? 1 : -1;
   c = p2->nAction - p1->nAction;
   if( c==0 ){
     c = p1->iOrder - p2->iOrder;
@@ -4632,6 +6126,104 @@ static int axset_compare(const void *a, const void *b){
   return c;
 }
 
+/* One case label of a switch written by print_coded_actions() */
+struct coded_case {
+  int iSym;            /* The lookahead symbol */
+  int action;          /* Its action, as computed by compute_action() */
+};
+
+/*
+** Compare two coded_case structures so that symbols with the same
+** action end up next to each other
+*/
+static int coded_case_compare(const void *a, const void *b){
+  const struct coded_case *p1 = (const struct coded_case*)a;
+  const struct coded_case *p2 = (const struct coded_case*)b;
+  int c = p1->action - p2->action;
+  if( c==0 ) c = p1->iSym - p2->iSym;
+  return c;
+}
+
+/*
+** Write the actions of every state as nested switch statements, for the
+** -k option.  If isTkn is true the function covers the terminals and is
+** called yy_coded_shift_action(), otherwise it covers the nonterminals
+** and is called yy_coded_reduce_action().  Either one returns
+** YY_NO_ACTION for a lookahead that is not in the action list of the
+** state, leaving fallbacks, wildcards and defaults to the template.
+**
+** A lookahead can have more than one action that compute_action() keeps,
+** for example the ERROR left by a %nonassoc shift/reduce resolution and
+** the REDUCE beside it.  acttab_insert() lets the last of them win, so
+** that is the one written here too.
+*/
+PRIVATE void print_coded_actions(
+  FILE *out,
+  struct lemon *lemp,
+  int isTkn,
+  int *plineno
+){
+  struct coded_case *aCase;
+  int *aSlot;          /* aCase[] index of each lookahead, or -1 */
+  struct state *stp;
+  struct action *ap;
+  int i, j, n, lineno = *plineno;
+
+  aCase = (struct coded_case*)malloc( lemp->nsymbol*sizeof(aCase[0]) );
+  aSlot = (int*)malloc( (lemp->nsymbol+1)*sizeof(aSlot[0]) );
+  MemoryCheck(aCase);
+  MemoryCheck(aSlot);
+  for(j=0; j<=lemp->nsymbol; j++) aSlot[j] = -1;
+  fprintf(out, "static YYACTIONTYPE yy_coded_%s_action(\n",
+          isTkn ? "shift" : "reduce"); lineno++;
+  fprintf(out, "  YYACTIONTYPE stateno,\n"
+               "  YYCODETYPE iLookAhead\n"
+               "){\n"
+               "  switch( stateno ){\n"); lineno += 4;
+  for(i=0; i<lemp->nxstate; i++){
+    stp = lemp->sorted[i];
+    for(n=0, ap=stp->ap; ap; ap=ap->next){
+      int action;
+      if( isTkn ){
+        if( ap->sp->index>=lemp->nterminal ) continue;
+      }else{
+        if( ap->sp->index<lemp->nterminal ) continue;
+        if( ap->sp->index==lemp->nsymbol ) continue;
+      }
+      action = compute_action(lemp, ap);
+      if( action<0 ) continue;
+      if( aSlot[ap->sp->index]>=0 ){
+        aCase[aSlot[ap->sp->index]].action = action;
+        continue;
+      }
+      aSlot[ap->sp->index] = n;
+      aCase[n].iSym = ap->sp->index;
+      aCase[n].action = action;
+      n++;
+    }
+    for(j=0; j<n; j++) aSlot[aCase[j].iSym] = -1;
+    if( n==0 ) continue;
+    qsort(aCase, n, sizeof(aCase[0]), coded_case_compare);
+    fprintf(out, "    case %d: switch( iLookAhead ){\n", i); lineno++;
+    for(j=0; j<n; j++){
+      if( j==0 || aCase[j].action!=aCase[j-1].action ){
+        fprintf(out, "      ");
+      }
+      fprintf(out, "case %d: ", aCase[j].iSym);
+      if( j==n-1 || aCase[j].action!=aCase[j+1].action ){
+        fprintf(out, "return %d;\n", aCase[j].action); lineno++;
+      }
+    }
+    fprintf(out, "    } break;\n"); lineno++;
+  }
+  fprintf(out, "  }\n"
+               "  return YY_NO_ACTION;\n"
+               "}\n"); lineno += 3;
+  free(aCase);
+  free(aSlot);
+  *plineno = lineno;
+}
+
 /*
 ** Write text on "out" that describes the rule "rp".
 */
@@ -4934,6 +6526,9 @@ void ReportTable(
   const char *name;
   int mnTknOfst, mxTknOfst;
   int mnNtOfst, mxNtOfst;
+  int coded;            /* True to code the actions as switches (-k) */
+  unsigned long long nHit = 0; /* Lookups in the -G profile */
+  unsigned long long nHitSoFar; /* Lookups in the sets aligned so far */
   struct axset *ax;
   char *prefix;
 
@@ -4955,7 +6550,7 @@ void ReportTable(
 
   fprintf(out,
      "/* This file is automatically generated by Lemon from input grammar\n"
-     "** source file \"%s\". */\n", lemp->filename); lineno += 2;
+     "** source file \"%s\"", lemp->filename); lineno++;
   if( lemp->nDefineUsed==0 ){
     fprintf(out, ".\n*/\n"); lineno += 2;
   }else{
@@ -5025,6 +6620,9 @@ void ReportTable(
     fprintf(out,"#define YYSTACKDEPTH 100\n");  lineno++;
   }
   fprintf(out, "#endif\n"); lineno++;
+  if( lemp->splitStack ){
+    fprintf(out,"#define YYSTACKSPLIT 1\n"); lineno++;
+  }
   if( mhflag ){
     fprintf(out,"#if INTERFACE\n"); lineno++;
   }
@@ -5075,6 +6673,9 @@ void ReportTable(
   if( lemp->has_fallback ){
     fprintf(out,"#define YYFALLBACK 1\n");  lineno++;
   }
+  if( lemp->resolveFallback && (lemp->has_fallback || lemp->wildcard) ){
+    fprintf(out,"#define YYRESOLVEDFALLBACK 1\n");  lineno++;
+  }
 
   /* Compute the action table, but do not output it yet.  The action
   ** table must be computed before generating the YYNSTATE macro because
@@ -5090,9 +6691,12 @@ void ReportTable(
     ax[i*2].stp = stp;
     ax[i*2].isTkn = 1;
     ax[i*2].nAction = stp->nTknAct;
+    ax[i*2].nHit = stp->nTknHit;
     ax[i*2+1].stp = stp;
     ax[i*2+1].isTkn = 0;
     ax[i*2+1].nAction = stp->nNtAct;
+    ax[i*2+1].nHit = stp->nNtHit;
+    nHit += stp->nTknHit + stp->nNtHit;
   }
   mxTknOfst = mnTknOfst = 0;
   mxNtOfst = mnNtOfst = 0;
@@ -5100,6 +6704,14 @@ void ReportTable(
   ** of placing the largest action sets first */
   for(i=0; i<lemp->nxstate*2; i++) ax[i].iOrder = i;
   qsort(ax, lemp->nxstate*2, sizeof(ax[0]), axset_compare);
+  /* With a -G profile, the busiest sets that between them account for
+  ** nine tenths of the lookups are kept within as few 64-byte cache lines
+  ** as possible */
+  for(i=0, nHitSoFar=0; i<lemp->nxstate*2 && ax[i].nAction>0
+                        && nHitSoFar*10<nHit*9; i++){
+    ax[i].nAlign = 64/szActionType;
+    nHitSoFar += ax[i].nHit;
+  }
   pActtab = acttab_alloc(lemp->nsymbol, lemp->nterminal);
   for(i=0; i<lemp->nxstate*2 && ax[i].nAction>0; i++){
     stp = ax[i].stp;
@@ -5111,7 +6723,7 @@ void ReportTable(
         if( action<0 ) continue;
         acttab_action(pActtab, ap->sp->index, action);
       }
-      stp->iTknOfst = acttab_insert(pActtab, 1);
+      stp->iTknOfst = acttab_insert(pActtab, 1, ax[i].nAlign);
       if( stp->iTknOfst<mnTknOfst ) mnTknOfst = stp->iTknOfst;
       if( stp->iTknOfst>mxTknOfst ) mxTknOfst = stp->iTknOfst;
     }else{
@@ -5123,7 +6735,7 @@ void ReportTable(
         if( action<0 ) continue;
         acttab_action(pActtab, ap->sp->index, action);
       }
-      stp->iNtOfst = acttab_insert(pActtab, 0);
+      stp->iNtOfst = acttab_insert(pActtab, 0, ax[i].nAlign);
       if( stp->iNtOfst<mnNtOfst ) mnNtOfst = stp->iNtOfst;
       if( stp->iNtOfst>mxNtOfst ) mxNtOfst = stp->iNtOfst;
     }
@@ -5172,6 +6784,25 @@ void ReportTable(
   fprintf(out,"#define YY_MAX_REDUCE        %d\n", i-1); lineno++;
   tplt_xfer(lemp->name,in,out,&lineno);
 
+  /* With -k, small automata are coded as switch statements.  The tables
+  ** that those replace are then only compiled for YYCOVERAGE. */
+  coded = 0;
+  if( lemp->mxCoded>0 ){
+    for(i=n=0; i<lemp->nxstate; i++){
+      n += lemp->sorted[i]->nTknAct + lemp->sorted[i]->nNtAct;
+    }
+    if( n<=lemp->mxCoded ){
+      coded = 1;
+    }else{
+      fprintf(stderr,"%d actions exceed the -k limit of %d.  "
+              "Using tables instead.\n", n, lemp->mxCoded);
+    }
+  }
+  if( coded ){
+    fprintf(out, "#define YYCODEDACTIONS 1\n"); lineno++;
+    fprintf(out, "#if defined(YYCOVERAGE)\n"); lineno++;
+  }
+
   /* Now output the action table and its associates:
   **
   **  yy_action[]        A single table containing all actions.
@@ -5186,9 +6817,10 @@ void ReportTable(
 
   /* Output the yy_action table */
   lemp->nactiontab = n = acttab_action_size(pActtab);
-  lemp->tablesize += n*szActionType;
+  if( !coded ) lemp->tablesize += n*szActionType;
   fprintf(out,"#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
-  fprintf(out,"static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
+  fprintf(out,"static const YYACTIONTYPE yy_action[]%s = {\n",
+          lemp->zProfile ? " YYALIGNED(64)" : ""); lineno++;
   for(i=j=0; i<n; i++){
     int action = acttab_yyaction(pActtab, i);
     if( action<0 ) action = lemp->noAction;
@@ -5205,8 +6837,9 @@ void ReportTable(
 
   /* Output the yy_lookahead table */
   lemp->nlookaheadtab = n = acttab_lookahead_size(pActtab);
-  lemp->tablesize += n*szCodeType;
-  fprintf(out,"static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
+  if( !coded ) lemp->tablesize += n*szCodeType;
+  fprintf(out,"static const YYCODETYPE yy_lookahead[]%s = {\n",
+          lemp->zProfile ? " YYALIGNED(64)" : ""); lineno++;
   for(i=j=0; i<n; i++){
     int la = acttab_yylookahead(pActtab, i);
     if( la<0 ) la = lemp->nsymbol;
@@ -5238,15 +6871,19 @@ void ReportTable(
   fprintf(out, "};\n"); lineno++;
 
   /* Output the yy_shift_ofst[] table */
+  /* States without token actions at the end can be left out, unless they
+  ** have nonterminal actions.  Those are still looked up with tokens, and
+  ** after a -G reordering one of them can end up last. */
   n = lemp->nxstate;
-  while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET ) n--;
+  while( n>0 && lemp->sorted[n-1]->iTknOfst==NO_OFFSET
+         && lemp->sorted[n-1]->nNtAct==0 ) n--;
   fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n-1); lineno++;
   fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
   fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
   fprintf(out, "static const %s yy_shift_ofst[] = {\n",
        minimum_size_type(mnTknOfst, lemp->nterminal+lemp->nactiontab, &sz));
        lineno++;
-  lemp->tablesize += n*sz;
+  if( !coded ) lemp->tablesize += n*sz;
   for(i=j=0; i<n; i++){
     int ofst;
     stp = lemp->sorted[i];
@@ -5271,7 +6908,7 @@ void ReportTable(
   fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
   fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
           minimum_size_type(mnNtOfst-1, mxNtOfst, &sz)); lineno++;
-  lemp->tablesize += n*sz;
+  if( !coded ) lemp->tablesize += n*sz;
   for(i=j=0; i<n; i++){
     int ofst;
     stp = lemp->sorted[i];
@@ -5287,6 +6924,9 @@ void ReportTable(
     }
   }
   fprintf(out, "};\n"); lineno++;
+  if( coded ){
+    fprintf(out, "#endif /* YYCOVERAGE */\n"); lineno++;
+  }
 
   /* Output the default action table */
   fprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
@@ -5308,6 +6948,39 @@ void ReportTable(
     }
   }
   fprintf(out, "};\n"); lineno++;
+
+  /* Output the switch statements that take the place of the tables */
+  if( coded ){
+    print_coded_actions(out, lemp, 1, &lineno);
+    print_coded_actions(out, lemp, 0, &lineno);
+  }
+
+  /* Output the marks of the lookups that -F resolved, two bits for each
+  ** state and terminal.  Only YYSTATS and YYTRACERING need them. */
+  if( lemp->resolveFallback && (lemp->has_fallback || lemp->wildcard) ){
+    int nPair = lemp->nxstate*lemp->nterminal;
+    fprintf(out, "#if defined(YYSTATS) || defined(YYTRACERING)\n"); lineno++;
+    fprintf(out, "static const unsigned char yy_resolved[] = {\n"); lineno++;
+    for(i=j=0; i<nPair; i+=4){
+      int k, v = 0;
+      for(k=0; k<4 && i+k<nPair; k++){
+        stp = lemp->sorted[(i+k)/lemp->nterminal];
+        if( stp->aResolved ){
+          v |= stp->aResolved[(i+k)%lemp->nterminal]<<(2*k);
+        }
+      }
+      if( j==0 ) fprintf(out," /* %5d */ ", i);
+      fprintf(out, " %3d,", v);
+      if( j==9 || i+4>=nPair ){
+        fprintf(out, "\n"); lineno++;
+        j = 0;
+      }else{
+        j++;
+      }
+    }
+    fprintf(out, "};\n"); lineno++;
+    fprintf(out, "#endif\n"); lineno++;
+  }
   tplt_xfer(lemp->name,in,out,&lineno);
 
   /* Generate the table of fallback tokens.
@@ -5557,16 +7230,24 @@ void ReportHeader(struct lemon *lemp)
 ** it the default.  Except, there is no default if the wildcard token
 ** is a possible look-ahead.
 */
-void CompressTables(struct lemon *lemp)
-{
+/* Choose the default reduce action for states iFirst..iLast-1 */
+static void default_reduce_work(
+  struct lemon *lemp,
+  void *pArg,
+  int iChunk,
+  int iFirst,
+  int iLast
+){
+  struct symbol *spDefault = (struct symbol*)pArg;
   struct state *stp;
-  struct action *ap, *ap2, *nextap;
+  struct action *ap, *ap2;
   struct rule *rp, *rp2, *rbest;
   int nbest, n;
   int i;
   int usesWildcard;
 
-  for(i=0; i<lemp->nstate; i++){
+  (void)iChunk;
+  for(i=iFirst; i<iLast; i++){
     stp = lemp->sorted[i];
     nbest = 0;
     rbest = 0;
@@ -5605,7 +7286,7 @@ void CompressTables(struct lemon *lemp)
       if( ap->type==REDUCE && ap->x.rp==rbest ) break;
     }
     assert( ap );
-    ap->sp = Symbol_new(lemp, "{default}");
+    ap->sp = spDefault;
     for(ap=ap->next; ap; ap=ap->next){
       if( ap->type==REDUCE && ap->x.rp==rbest ) ap->type = NOT_USED;
     }
@@ -5620,6 +7301,21 @@ void CompressTables(struct lemon *lemp)
       stp->pDfltReduce = rbest;
     }
   }
+}
+
+void CompressTables(struct lemon *lemp)
+{
+  struct state *stp;
+  struct action *ap, *ap2, *nextap;
+  struct rule *rp;
+  int i;
+
+  /* Pick a default reduce for every state.  The states do not depend on
+  ** each other, so this is split among the -j threads.  The "{default}"
+  ** symbol is looked up first because the symbol table is not safe to
+  ** use from several threads. */
+  Parallel_for(lemp, lemp->nstate, default_reduce_work,
+               Symbol_new(lemp, "{default}"));
 
   /* Make a second pass over all states and actions.  Convert
   ** every action that is a SHIFT to an autoReduce state into
@@ -5693,17 +7389,21 @@ static int stateResortCompare(const void *a, const void *b){
 }
 
 
-/*
-** Renumber and resort states so that states with fewer choices
-** occur at the end.  Except, keep state 0 as the first state.
-*/
-void ResortStates(struct lemon *lemp)
-{
+/* Count the token and nonterminal actions of states iFirst..iLast-1 */
+static void resort_count_work(
+  struct lemon *lemp,
+  void *pArg,
+  int iChunk,
+  int iFirst,
+  int iLast
+){
   int i;
   struct state *stp;
   struct action *ap;
 
-  for(i=0; i<lemp->nstate; i++){
+  (void)pArg;
+  (void)iChunk;
+  for(i=iFirst; i<iLast; i++){
     stp = lemp->sorted[i];
     stp->nTknAct = stp->nNtAct = 0;
     stp->iDfltReduce = -1; /* Init dflt action to "syntax error" */
@@ -5723,69 +7423,434 @@ void ResortStates(struct lemon *lemp)
       }
     }
   }
-  qsort(&lemp->sorted[1], lemp->nstate-1, sizeof(lemp->sorted[0]),
-        stateResortCompare);
-  for(i=0; i<lemp->nstate; i++){
-    lemp->sorted[i]->statenum = i;
-  }
+}
+
+/*
+** Renumber and resort states so that states with fewer choices
+** occur at the end.  Except, keep state 0 as the first state.
+*/
+void ResortStates(struct lemon *lemp)
+{
+  int i;
+
+  Parallel_for(lemp, lemp->nstate, resort_count_work, 0);
+  qsort(&lemp->sorted[1], lemp->nstate-1, sizeof(lemp->sorted[0]),
+        stateResortCompare);
+  for(i=0; i<lemp->nstate; i++){
+    lemp->sorted[i]->statenum = i;
+  }
   lemp->nxstate = lemp->nstate;
   while( lemp->nxstate>1 && lemp->sorted[lemp->nxstate-1]->autoReduce ){
     lemp->nxstate--;
   }
 }
 
+/*
+** Compare two states by the lookups that the -G profile counted in
+** them, busiest first.  States with equal counts keep their order.
+*/
+static int stateProfileCompare(const void *a, const void *b){
+  const struct state *pA = *(const struct state**)a;
+  const struct state *pB = *(const struct state**)b;
+  unsigned long long nA = pA->nTknHit + pA->nNtHit;
+  unsigned long long nB = pB->nTknHit + pB->nNtHit;
+  if( nA!=nB ) return nA<nB ? 1 : -1;
+  return pA->statenum - pB->statenum;
+}
+
+/*
+** Read the profile named by the -G option and renumber the states so
+** that the busiest ones come first, after state 0.  The profile is the
+** output of ParseProfile() in a parser generated with YYPROFILE defined
+** and without -G, so its state numbers are those of ResortStates().
+** The profile format is:
+**
+**     profile NSTATE NSYMBOL NRULE
+**     lookup STATE SYMBOL COUNT       (repeated)
+**     rule RULE COUNT                 (repeated)
+**
+** The rule counts are not used for the layout.
+*/
+void ProfileStates(struct lemon *lemp)
+{
+  FILE *in;
+  char zLine[200];
+  int nState, nSymbol, nRule, iState, iSymbol, i;
+  unsigned long long n;
+  struct state *stp;
+
+  in = fopen(lemp->zProfile, "rb");
+  if( in==0 ){
+    ErrorMsg(lemp->zProfile, 0, "Can't open this profile for reading.");
+    lemp->errorcnt++;
+    return;
+  }
+  if( fgets(zLine, sizeof(zLine), in)==0
+   || sscanf(zLine, "profile %d %d %d", &nState, &nSymbol, &nRule)!=3
+   || nState!=lemp->nxstate || nSymbol!=lemp->nsymbol || nRule!=lemp->nrule
+  ){
+    ErrorMsg(lemp->zProfile, 1,
+       "This profile is not from a parser built from this grammar.");
+    lemp->errorcnt++;
+    fclose(in);
+    return;
+  }
+  for(i=2; fgets(zLine, sizeof(zLine), in); i++){
+    if( sscanf(zLine, "lookup %d %d %llu", &iState, &iSymbol, &n)==3 ){
+      if( iState<0 || iState>=lemp->nxstate
+       || iSymbol<0 || iSymbol>=lemp->nsymbol ){
+        ErrorMsg(lemp->zProfile, i, "State or symbol out of range.");
+        lemp->errorcnt++;
+        continue;
+      }
+      stp = lemp->sorted[iState];
+      if( iSymbol<lemp->nterminal ){
+        stp->nTknHit += n;
+      }else{
+        stp->nNtHit += n;
+      }
+    }
+  }
+  fclose(in);
+
+  qsort(&lemp->sorted[1], lemp->nstate-1, sizeof(lemp->sorted[0]),
+        stateProfileCompare);
+  for(i=0; i<lemp->nstate; i++){
+    lemp->sorted[i]->statenum = i;
+  }
+  lemp->nxstate = lemp->nstate;
+  while( lemp->nxstate>1 && lemp->sorted[lemp->nxstate-1]->autoReduce ){
+    lemp->nxstate--;
+  }
+}
+
+/*
+** For the -F option.  When a lookahead has no action in a state, the
+** parser tries the fallback token of the lookahead and then the wildcard
+** before it takes the default action of the state.  Do that here for
+** every state and terminal, and add the action that is found to the
+** state, so that the parser finds it with a single lookup.  This is done
+** on the compressed automaton, as that is what the parser searches.
+**
+** The parser can then no longer tell these lookups apart from the others,
+** so every state also records, in aResolved[], which terminals took the
+** fallback (RESOLVED_FALLBACK) and then the wildcard (RESOLVED_WILDCARD).
+** These become the yy_resolved[] table, from which the YYSTATS fallback
+** count and the YYTRACERING fallback and wildcard events still work.
+*/
+#define RESOLVED_FALLBACK  1
+#define RESOLVED_WILDCARD  2
+
+void ResolveFallbacks(struct lemon *lemp)
+{
+  struct action **aAct;   /* Table entry of each terminal in one state */
+  struct action *ap, *apNew;
+  struct state *stp;
+  int i, iSym, iLook;
+  int iWild = lemp->wildcard ? lemp->wildcard->index : -1;
+
+  if( lemp->has_fallback==0 && lemp->wildcard==0 ) return;
+  aAct = (struct action**)malloc(sizeof(aAct[0])*lemp->nterminal);
+  MemoryCheck(aAct);
+  for(i=0; i<lemp->nxstate; i++){
+    stp = lemp->sorted[i];
+    memset(aAct, 0, sizeof(aAct[0])*lemp->nterminal);
+    for(ap=stp->ap; ap; ap=ap->next){
+      if( ap->sp->index>=lemp->nterminal ) continue;
+      if( compute_action(lemp, ap)<0 ) continue;
+      aAct[ap->sp->index] = ap;
+    }
+    for(iSym=1; iSym<lemp->nterminal; iSym++){
+      int mark = 0;
+      if( aAct[iSym] ) continue;
+      iLook = iSym;
+      ap = 0;
+      if( lemp->symbols[iSym]->fallback ){
+        iLook = lemp->symbols[iSym]->fallback->index;
+        ap = aAct[iLook];
+        mark = RESOLVED_FALLBACK;
+      }
+      if( ap ){
+        lemp->nFallbackResolved++;
+      }else if( iWild>=0 && iLook>0 && aAct[iWild] ){
+        ap = aAct[iWild];
+        mark |= RESOLVED_WILDCARD;
+        lemp->nWildcardResolved++;
+      }
+      if( mark ){
+        if( stp->aResolved==0 ){
+          stp->aResolved = (unsigned char*)Arena_alloc(lemp, lemp->nterminal);
+        }
+        stp->aResolved[iSym] = (unsigned char)mark;
+      }
+      if( ap==0 ) continue;
+      apNew = Action_new(lemp);
+      apNew->type = ap->type;
+      apNew->sp = lemp->symbols[iSym];
+      apNew->x = ap->x;
+      apNew->next = stp->ap;
+      stp->ap = apNew;
+      stp->nTknAct++;
+    }
+  }
+  free(aAct);
+}
+
+
+/***************** From the file "arena.c" **********************************/
+/*
+** Region allocator for the automaton built by the LEMON parser generator.
+*/
+#define ARENA_BLOCK_SIZE (256*1024)
+
+/* Return n bytes of zeroed memory owned by the arena of lemp */
+void *Arena_alloc(struct lemon *lemp, size_t n)
+{
+  struct arena_block *blk = lemp->arena;
+  void *p;
+  n = (n + sizeof(double) - 1) & ~(sizeof(double) - 1);
+  if( blk==0 || blk->used + n > blk->size ){
+    size_t sz = n > ARENA_BLOCK_SIZE ? n : ARENA_BLOCK_SIZE;
+    blk = (struct arena_block*)calloc(1, sizeof(struct arena_block) + sz);
+    if( blk==0 ){
+      memory_error();
+    }
+    blk->size = sz;
+    blk->used = 0;
+    blk->next = lemp->arena;
+    lemp->arena = blk;
+  }
+  p = (char*)blk->data + blk->used;
+  blk->used += n;
+  return p;
+}
+
+/* Release every object allocated from the arena of lemp.  The free lists
+** point into the arena, so they are emptied as well. */
+void Arena_reset(struct lemon *lemp)
+{
+  struct arena_block *blk, *next;
+  for(blk=lemp->arena; blk; blk=next){
+    next = blk->next;
+    free(blk);
+  }
+  lemp->arena = 0;
+  lemp->freelist = 0;
+  lemp->plink_freelist = 0;
+  lemp->setfreelist = 0;
+}
+
+/***************** From the file "parallel.c" *******************************/
+/*
+** A minimal fork/join helper for the LEMON parser generator.  The items
+** are split into at most lemp->nthread contiguous chunks.  Each chunk
+** runs on its own thread, and results are combined by chunk number, so
+** the output never depends on the number of threads or on timing.
+*/
+struct parallel_job {
+  struct lemon *lemp;      /* The parser generator */
+  ParallelWork xWork;      /* Routine to run */
+  void *pArg;              /* Its argument */
+  int iChunk;              /* Chunk number */
+  int iFirst, iLast;       /* Items iFirst..iLast-1 belong to this chunk */
+};
+
+static void *Parallel_run(void *pJob){
+  struct parallel_job *p = (struct parallel_job*)pJob;
+  p->xWork(p->lemp, p->pArg, p->iChunk, p->iFirst, p->iLast);
+  return 0;
+}
+
+/* Return the number of chunks Parallel_for() uses for n items */
+int Parallel_nchunk(struct lemon *lemp, int n)
+{
+  int nchunk = lemp->nthread>1 ? lemp->nthread : 1;
+#ifndef LEMON_THREADS
+  nchunk = 1;
+#endif
+  if( nchunk>n ) nchunk = n>1 ? n : 1;
+  return nchunk;
+}
+
+/* Run xWork over the items 0..n-1 and wait for it to finish */
+void Parallel_for(struct lemon *lemp, int n, ParallelWork xWork, void *pArg)
+{
+  int nchunk = Parallel_nchunk(lemp, n);
+  struct parallel_job *aJob;
+  int i;
+
+  if( nchunk==1 ){
+    xWork(lemp, pArg, 0, 0, n);
+    return;
+  }
+  aJob = (struct parallel_job*)calloc(nchunk, sizeof(aJob[0]));
+  MemoryCheck(aJob);
+  for(i=0; i<nchunk; i++){
+    aJob[i].lemp = lemp;
+    aJob[i].xWork = xWork;
+    aJob[i].pArg = pArg;
+    aJob[i].iChunk = i;
+    aJob[i].iFirst = (int)(((long long)n*i)/nchunk);
+    aJob[i].iLast = (int)(((long long)n*(i+1))/nchunk);
+  }
+#ifdef LEMON_THREADS
+  {
+    pthread_t *aThread = (pthread_t*)calloc(nchunk, sizeof(pthread_t));
+    char *aStarted = (char*)calloc(nchunk, 1);
+    MemoryCheck(aThread);
+    MemoryCheck(aStarted);
+    for(i=1; i<nchunk; i++){
+      aStarted[i] = pthread_create(&aThread[i], 0, Parallel_run, &aJob[i])==0;
+    }
+    Parallel_run(&aJob[0]);
+    for(i=1; i<nchunk; i++){
+      if( aStarted[i] ){
+        pthread_join(aThread[i], 0);
+      }else{
+        Parallel_run(&aJob[i]);   /* Could not start a thread.  Run it here */
+      }
+    }
+    free(aThread);
+    free(aStarted);
+  }
+#else
+  for(i=0; i<nchunk; i++) Parallel_run(&aJob[i]);
+#endif
+  free(aJob);
+}
 
 /***************** From the file "set.c" ************************************/
 /*
 ** Set manipulation routines for the LEMON parser generator.
+**
+** A set holds one bit per element, packed into 64-bit SetWords.  The
+** union operation is the inner loop of FindFirstSets(), Configlist_closure()
+** and FindFollowSets(), so on x86 it is done with SSE2 or AVX2 kernels
+** when available.  The kernel is chosen once, at SetSize() time, based
+** on what the CPU running lemon supports.
 */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LEMON_SET_X86 1
+#endif
+
+/* Portable union kernel.  Return TRUE if s1 changes. */
+static int SetUnionScalar(SetWord *s1, const SetWord *s2, int n)
+{
+  int i;
+  SetWord changed = 0;
+  for(i=0; i<n; i++){
+    SetWord w = s1[i] | s2[i];
+    changed |= w ^ s1[i];
+    s1[i] = w;
+  }
+  return changed!=0;
+}
+
+#if defined(LEMON_SET_X86) && defined(__SSE2__)
+/* Union kernel using 128-bit SSE2 registers */
+static int SetUnionSSE2(SetWord *s1, const SetWord *s2, int n)
+{
+  int i;
+  SetWord changed = 0;
+  __m128i acc = _mm_setzero_si128();
+  for(i=0; i+2<=n; i+=2){
+    __m128i a = _mm_loadu_si128((const __m128i*)&s1[i]);
+    __m128i b = _mm_loadu_si128((const __m128i*)&s2[i]);
+    acc = _mm_or_si128(acc, _mm_andnot_si128(a, b));
+    _mm_storeu_si128((__m128i*)&s1[i], _mm_or_si128(a, b));
+  }
+  if( _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128()))!=0xffff ){
+    changed = 1;
+  }
+  for(; i<n; i++){
+    changed |= s2[i] & ~s1[i];
+    s1[i] |= s2[i];
+  }
+  return changed!=0;
+}
+#endif
+
+#if defined(LEMON_SET_X86)
+/* Union kernel using 256-bit AVX2 registers */
+__attribute__((target("avx2")))
+static int SetUnionAVX2(SetWord *s1, const SetWord *s2, int n)
+{
+  int i;
+  SetWord changed = 0;
+  __m256i acc = _mm256_setzero_si256();
+  for(i=0; i+4<=n; i+=4){
+    __m256i a = _mm256_loadu_si256((const __m256i*)&s1[i]);
+    __m256i b = _mm256_loadu_si256((const __m256i*)&s2[i]);
+    acc = _mm256_or_si256(acc, _mm256_andnot_si256(a, b));
+    _mm256_storeu_si256((__m256i*)&s1[i], _mm256_or_si256(a, b));
+  }
+  if( !_mm256_testz_si256(acc, acc) ) changed = 1;
+  for(; i<n; i++){
+    changed |= s2[i] & ~s1[i];
+    s1[i] |= s2[i];
+  }
+  return changed!=0;
+}
+#endif
 
-/* Set the set size */
+/* Set the set size, and pick the fastest union kernel for this CPU */
 void SetSize(struct lemon *lem, int n)
 {
   lem->set_size = n+1;
+  lem->set_words = (lem->set_size + SETWORD_BITS - 1)/SETWORD_BITS;
+  lem->xSetUnion = SetUnionScalar;
+#if defined(LEMON_SET_X86)
+  __builtin_cpu_init();
+  if( lem->set_words>=4 && __builtin_cpu_supports("avx2") ){
+    lem->xSetUnion = SetUnionAVX2;
+  }
+#if defined(__SSE2__)
+  else if( lem->set_words>=2 ){
+    lem->xSetUnion = SetUnionSSE2;
+  }
+#endif
+#endif
 }
 
-/* Allocate a new set */
-char *SetNew(struct lemon *lem){
-  char *s;
-  s = (char*)calloc( lem->set_size, 1);
-  if( s==0 ){
-    memory_error();
+/* Allocate a new set.  Sets come from the arena, so sets allocated one
+** after another are also adjacent in memory. */
+SetWord *SetNew(struct lemon *lem){
+  SetWord *s;
+  if( lem->setfreelist ){
+    s = lem->setfreelist;
+    memcpy(&lem->setfreelist, s, sizeof(SetWord*));
+    memset(s, 0, lem->set_words*sizeof(SetWord));
+  }else{
+    s = (SetWord*)Arena_alloc(lem, lem->set_words*sizeof(SetWord));
   }
   return s;
 }
 
-/* Deallocate a set */
-void SetFree(char *s)
+/* Deallocate a set.  The storage is kept for reuse by SetNew(). */
+void SetFree(struct lemon *lem, SetWord *s)
 {
-  free(s);
+  memcpy(s, &lem->setfreelist, sizeof(SetWord*));
+  lem->setfreelist = s;
 }
 
 /* Add a new element to the set.  Return TRUE if the element was added
 ** and FALSE if it was already there. */
-int SetAdd(struct lemon *lem, char *s, int e)
+int SetAdd(struct lemon *lem, SetWord *s, int e)
 {
+  SetWord mask;
   int rv;
   assert( e>=0 && e<lem->set_size );
-  rv = s[e];
-  s[e] = 1;
+  mask = ((SetWord)1) << (e%SETWORD_BITS);
+  rv = (s[e/SETWORD_BITS] & mask)!=0;
+  s[e/SETWORD_BITS] |= mask;
   return !rv;
 }
 
 /* Add every element of s2 to s1.  Return TRUE if s1 changes. */
-int SetUnion(struct lemon *lem, char *s1, char *s2)
+int SetUnion(struct lemon *lem, SetWord *s1, SetWord *s2)
 {
-  int i, progress;
-  progress = 0;
-  for(i=0; i<lem->set_size; i++){
-    if( s2[i]==0 ) continue;
-    if( s1[i]==0 ){
-      progress = 1;
-      s1[i] = 1;
-    }
-  }
-  return progress;
+  return lem->xSetUnion(s1, s2, lem->set_words);
 }
 /********************** From the file "table.c" ****************************/
 /*
@@ -5800,11 +7865,159 @@ int SetUnion(struct lemon *lem, char *s1, char *s2)
 ** Code for processing tables in the LEMON parser generator.
 */
 
+/*
+** All four tables below share one open-addressing hash table.  The
+** entries are kept in a dense array in order of insertion, which is the
+** order Symbol_arrayof() and State_arrayof() must return, and the slots
+** of the hash table hold entry numbers.  The full hash of every entry is
+** stored next to it, so a probe only compares keys when the hashes are
+** equal and growing the table never hashes a key again.  Entries are
+** never deleted one at a time, only all at once by Configtable_clear(),
+** so no tombstones are needed.
+*/
+struct s_htable {
+  int size;               /* Number of slots.  A power of 2 */
+  int count;              /* Number of entries */
+  int nAlloc;             /* Entries allocated in aData[], aKey[], aHash[] */
+  void **aData;           /* The data, in order of insertion */
+  const void **aKey;      /* The key of each entry */
+  unsigned *aHash;        /* The full hash of each entry */
+  unsigned *aSlot;        /* 0 for an empty slot, else 1 + entry number */
+};
+
+/* Multiply two 64-bit numbers and fold the 128-bit product down to 64
+** bits.  This is the mixing step of wyhash. */
+PRIVATE unsigned long long hash_mum(unsigned long long a, unsigned long long b)
+{
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 r = (unsigned __int128)a * b;
+  return (unsigned long long)(r>>64) ^ (unsigned long long)r;
+#else
+  unsigned long long ha = a>>32, la = a&0xffffffff;
+  unsigned long long hb = b>>32, lb = b&0xffffffff;
+  unsigned long long rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb;
+  unsigned long long t = rl + (rm0<<32), c = t<rl;
+  unsigned long long lo = t + (rm1<<32);
+  c += lo<t;
+  return (rh + (rm0>>32) + (rm1>>32) + c) ^ lo;
+#endif
+}
+
+#define HASH_P0 0xa0761d6478bd642fULL
+#define HASH_P1 0xe7037ed1a0b428dbULL
+#define HASH_P2 0x8ebc6af09c88c6e3ULL
+
+/* Fold a 64-bit hash down to the 32 bits the tables store */
+#define HASH_FOLD(H) ((unsigned)((H) ^ ((H)>>32)))
+
 PRIVATE unsigned strhash(const char *x)
 {
-  unsigned h = 0;
-  while( *x ) h = h*13 + *(x++);
-  return h;
+  size_t n = strlen(x);
+  unsigned long long h = HASH_P0 ^ n;
+  unsigned long long a, b;
+  while( n>=16 ){
+    memcpy(&a, x, 8);
+    memcpy(&b, x+8, 8);
+    h = hash_mum(a^HASH_P1, b^h);
+    x += 16;
+    n -= 16;
+  }
+  a = b = 0;
+  if( n>8 ){
+    memcpy(&a, x, 8);
+    memcpy(&b, x+8, n-8);
+  }else{
+    memcpy(&a, x, n);
+  }
+  h = hash_mum(a^HASH_P1, b^h);
+  return HASH_FOLD(hash_mum(h^HASH_P2, HASH_P1));
+}
+
+/* Allocate a new table with room for nSlot/2 entries before it grows */
+PRIVATE struct s_htable *Htable_new(int nSlot)
+{
+  struct s_htable *p = (struct s_htable*)calloc(1, sizeof(struct s_htable));
+  if( p==0 ) return 0;
+  p->size = nSlot;
+  p->aSlot = (unsigned*)calloc(nSlot, sizeof(unsigned));
+  if( p->aSlot==0 ){
+    free(p);
+    return 0;
+  }
+  return p;
+}
+
+/* Free a table, but not the data it holds */
+PRIVATE void Htable_free(struct s_htable *p)
+{
+  if( p==0 ) return;
+  free(p->aData);
+  free(p->aKey);
+  free(p->aHash);
+  free(p->aSlot);
+  free(p);
+}
+
+/* Put entry number i, whose hash is h, into a slot */
+PRIVATE void Htable_link(struct s_htable *p, int i, unsigned h)
+{
+  unsigned mask = p->size - 1;
+  unsigned j;
+  for(j=h&mask; p->aSlot[j]; j=(j+1)&mask){}
+  p->aSlot[j] = i+1;
+}
+
+/* Append a new entry.  The caller has already made sure that the key
+** is not in the table.  Return TRUE if successful. */
+PRIVATE int Htable_append(
+  struct s_htable *p,
+  void *data,
+  const void *key,
+  unsigned h
+){
+  int i;
+  if( p->count>=p->nAlloc ){
+    int nNew = p->nAlloc ? p->nAlloc*2 : p->size/2;
+    void **aData = (void**)realloc(p->aData, nNew*sizeof(void*));
+    const void **aKey;
+    unsigned *aHash;
+    if( aData==0 ) return 0;
+    p->aData = aData;
+    aKey = (const void**)realloc((void*)p->aKey, nNew*sizeof(void*));
+    if( aKey==0 ) return 0;
+    p->aKey = aKey;
+    aHash = (unsigned*)realloc(p->aHash, nNew*sizeof(unsigned));
+    if( aHash==0 ) return 0;
+    p->aHash = aHash;
+    p->nAlloc = nNew;
+  }
+  if( (p->count+1)*2>p->size ){
+    /* Keep the load factor at or below 1/2 */
+    unsigned *aSlot = (unsigned*)calloc(p->size*2, sizeof(unsigned));
+    if( aSlot==0 ) return 0;
+    free(p->aSlot);
+    p->aSlot = aSlot;
+    p->size *= 2;
+    for(i=0; i<p->count; i++) Htable_link(p, i, p->aHash[i]);
+  }
+  i = p->count++;
+  p->aData[i] = data;
+  p->aKey[i] = key;
+  p->aHash[i] = h;
+  Htable_link(p, i, h);
+  return 1;
+}
+
+/* Return an array of pointers to all data in the table.
+** The array is obtained from malloc.  Return NULL if memory allocation
+** problems, or if the array is empty. */
+PRIVATE void **Htable_arrayof(struct s_htable *p, size_t szElem)
+{
+  void **array;
+  if( p==0 ) return 0;
+  array = (void**)calloc(p->count, szElem);
+  if( array && p->count ) memcpy(array, p->aData, p->count*sizeof(void*));
+  return array;
 }
 
 /* Works like strdup, sort of.  Save a string in malloced memory, but
@@ -5827,126 +8040,46 @@ const char *Strsafe(struct lemon *lemp, const char *y)
   return z;
 }
 
-/* There is one instance of the following structure for each
-** associative array of type "x1".
-*/
-struct s_x1 {
-  int size;               /* The number of available slots. */
-                          /*   Must be a power of 2 greater than or */
-                          /*   equal to 1 */
-  int count;              /* Number of currently slots filled */
-  struct s_x1node *tbl;  /* The data stored here */
-  struct s_x1node **ht;  /* Hash table for lookups */
-};
-
-/* There is one instance of this structure for every data element
-** in an associative array of type "x1".
-*/
-typedef struct s_x1node {
-  const char *data;        /* The data */
-  struct s_x1node *next;   /* Next entry with the same hash */
-  struct s_x1node **from;  /* Previous link */
-} x1node;
-
 /* Allocate a new associative array */
 void Strsafe_init(struct lemon *lemp){
   if( lemp->x1a ) return;
-  lemp->x1a = (struct s_x1*)malloc( sizeof(struct s_x1) );
-  if( lemp->x1a ){
-    lemp->x1a->size = 1024;
-    lemp->x1a->count = 0;
-    lemp->x1a->tbl = (x1node*)calloc(1024, sizeof(x1node) + sizeof(x1node*));
-    if( lemp->x1a->tbl==0 ){
-      free(lemp->x1a);
-      lemp->x1a = 0;
-    }else{
-      int i;
-      lemp->x1a->ht = (x1node**)&(lemp->x1a->tbl[1024]);
-      for(i=0; i<1024; i++) lemp->x1a->ht[i] = 0;
-    }
-  }
+  lemp->x1a = Htable_new(1024);
 }
 void Strsafe_deinit(struct lemon *lemp)
 {
     if( lemp->x1a ) {
         for(int i=0, imax=lemp->x1a->count; i < imax; ++i) {
-            free((char*)lemp->x1a->tbl[i].data);
+            free(lemp->x1a->aData[i]);
         }
-        free(lemp->x1a->tbl);
-        free(lemp->x1a);
+        Htable_free(lemp->x1a);
+        lemp->x1a = 0;
     }
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
 int Strsafe_insert(struct lemon *lemp, const char *data)
 {
-  x1node *np;
-  unsigned h;
-  unsigned ph;
-
   if( lemp->x1a==0 ) return 0;
-  ph = strhash(data);
-  h = ph & (lemp->x1a->size-1);
-  np = lemp->x1a->ht[h];
-  while( np ){
-    if( strcmp(np->data,data)==0 ){
-      /* An existing entry with the same key is found. */
-      /* Fail because overwrite is not allows. */
-      return 0;
-    }
-    np = np->next;
-  }
-  if( lemp->x1a->count>=lemp->x1a->size ){
-    /* Need to make the hash table bigger */
-    int i,arrSize;
-    struct s_x1 array;
-    array.size = arrSize = lemp->x1a->size*2;
-    array.count = lemp->x1a->count;
-    array.tbl = (x1node*)calloc(arrSize, sizeof(x1node) + sizeof(x1node*));
-    if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
-    array.ht = (x1node**)&(array.tbl[arrSize]);
-    for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<lemp->x1a->count; i++){
-      x1node *oldnp, *newnp;
-      oldnp = &(lemp->x1a->tbl[i]);
-      h = strhash(oldnp->data) & (arrSize-1);
-      newnp = &(array.tbl[i]);
-      if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
-      newnp->next = array.ht[h];
-      newnp->data = oldnp->data;
-      newnp->from = &(array.ht[h]);
-      array.ht[h] = newnp;
-    }
-    /* free(x1a->tbl); // This program was originally for 16-bit machines.
-    ** Don't worry about freeing memory on modern platforms. */
-    *lemp->x1a = array;
-  }
-  /* Insert the new data */
-  h = ph & (lemp->x1a->size-1);
-  np = &(lemp->x1a->tbl[lemp->x1a->count++]);
-  np->data = data;
-  if( lemp->x1a->ht[h] ) lemp->x1a->ht[h]->from = &(np->next);
-  np->next = lemp->x1a->ht[h];
-  lemp->x1a->ht[h] = np;
-  np->from = &(lemp->x1a->ht[h]);
-  return 1;
+  if( Strsafe_find(lemp, data) ) return 0;
+  return Htable_append(lemp->x1a, (void*)data, data, strhash(data));
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
 const char *Strsafe_find(struct lemon *lemp, const char *key)
 {
-  unsigned h;
-  x1node *np;
+  struct s_htable *p = lemp->x1a;
+  unsigned h, mask, j, e;
 
-  if( lemp->x1a==0 ) return 0;
-  h = strhash(key) & (lemp->x1a->size-1);
-  np = lemp->x1a->ht[h];
-  while( np ){
-    if( strcmp(np->data,key)==0 ) break;
-    np = np->next;
+  if( p==0 ) return 0;
+  h = strhash(key);
+  mask = p->size - 1;
+  for(j=h&mask; (e=p->aSlot[j])!=0; j=(j+1)&mask){
+    if( p->aHash[e-1]==h && strcmp((const char*)p->aKey[e-1],key)==0 ){
+      return (const char*)p->aData[e-1];
+    }
   }
-  return np ? np->data : 0;
+  return 0;
 }
 
 /* Return a pointer to the (terminal or nonterminal) symbol "x".
@@ -6002,55 +8135,20 @@ int Symbolcmpp(const void *_a, const void *_b)
   return i1==i2 ? a->index - b->index : i1 - i2;
 }
 
-/* There is one instance of the following structure for each
-** associative array of type "x2".
-*/
-struct s_x2 {
-  int size;               /* The number of available slots. */
-                          /*   Must be a power of 2 greater than or */
-                          /*   equal to 1 */
-  int count;              /* Number of currently slots filled */
-  struct s_x2node *tbl;  /* The data stored here */
-  struct s_x2node **ht;  /* Hash table for lookups */
-};
-
-/* There is one instance of this structure for every data element
-** in an associative array of type "x2".
-*/
-typedef struct s_x2node {
-  struct symbol *data;     /* The data */
-  const char *key;         /* The key */
-  struct s_x2node *next;   /* Next entry with the same hash */
-  struct s_x2node **from;  /* Previous link */
-} x2node;
-
 /* Allocate a new associative array */
 void Symbol_init(struct lemon *lem){
   if( lem->x2a ) return;
-  lem->x2a = (struct s_x2*)malloc( sizeof(struct s_x2) );
-  if( lem->x2a ){
-    lem->x2a->size = 128;
-    lem->x2a->count = 0;
-    lem->x2a->tbl = (x2node*)calloc(128, sizeof(x2node) + sizeof(x2node*));
-    if( lem->x2a->tbl==0 ){
-      free(lem->x2a);
-      lem->x2a = 0;
-    }else{
-      int i;
-      lem->x2a->ht = (x2node**)&(lem->x2a->tbl[128]);
-      for(i=0; i<128; i++) lem->x2a->ht[i] = 0;
-    }
-  }
+  lem->x2a = Htable_new(128);
 }
 
 void Symbol_deinit(struct lemon *lemp)
 {
     if( lemp->x2a ) {
         for(int i=0, imax=lemp->x2a->count; i < imax; ++i) {
-            free(lemp->x2a->tbl[i].data);
+            free(lemp->x2a->aData[i]);
         }
-        free(lemp->x2a->tbl);
-        free(lemp->x2a);
+        Htable_free(lemp->x2a);
+        lemp->x2a = 0;
     }
 }
 
@@ -6058,76 +8156,27 @@ void Symbol_deinit(struct lemon *lemp)
 ** Prior data with the same key is NOT overwritten */
 int Symbol_insert(struct lemon *lem, struct symbol *data, const char *key)
 {
-  x2node *np;
-  unsigned h;
-  unsigned ph;
-
   if( lem->x2a==0 ) return 0;
-  ph = strhash(key);
-  h = ph & (lem->x2a->size-1);
-  np = lem->x2a->ht[h];
-  while( np ){
-    if( strcmp(np->key,key)==0 ){
-      /* An existing entry with the same key is found. */
-      /* Fail because overwrite is not allows. */
-      return 0;
-    }
-    np = np->next;
-  }
-  if( lem->x2a->count>=lem->x2a->size ){
-    /* Need to make the hash table bigger */
-    int i,arrSize;
-    struct s_x2 array;
-    array.size = arrSize = lem->x2a->size*2;
-    array.count = lem->x2a->count;
-    array.tbl = (x2node*)calloc(arrSize, sizeof(x2node) + sizeof(x2node*));
-    if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
-    array.ht = (x2node**)&(array.tbl[arrSize]);
-    for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<lem->x2a->count; i++){
-      x2node *oldnp, *newnp;
-      oldnp = &(lem->x2a->tbl[i]);
-      h = strhash(oldnp->key) & (arrSize-1);
-      newnp = &(array.tbl[i]);
-      if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
-      newnp->next = array.ht[h];
-      newnp->key = oldnp->key;
-      newnp->data = oldnp->data;
-      newnp->from = &(array.ht[h]);
-      array.ht[h] = newnp;
-    }
-    /* free(x2a->tbl); // This program was originally written for 16-bit
-    ** machines.  Don't worry about freeing this trivial amount of memory
-    ** on modern platforms.  Just leak it. */
-    *lem->x2a = array;
-  }
-  /* Insert the new data */
-  h = ph & (lem->x2a->size-1);
-  np = &(lem->x2a->tbl[lem->x2a->count++]);
-  np->key = key;
-  np->data = data;
-  if( lem->x2a->ht[h] ) lem->x2a->ht[h]->from = &(np->next);
-  np->next = lem->x2a->ht[h];
-  lem->x2a->ht[h] = np;
-  np->from = &(lem->x2a->ht[h]);
-  return 1;
+  if( Symbol_find(lem, key) ) return 0;
+  return Htable_append(lem->x2a, data, key, strhash(key));
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
 struct symbol *Symbol_find(struct lemon *lem, const char *key)
 {
-  unsigned h;
-  x2node *np;
+  struct s_htable *p = lem->x2a;
+  unsigned h, mask, j, e;
 
-  if( lem->x2a==0 ) return 0;
-  h = strhash(key) & (lem->x2a->size-1);
-  np = lem->x2a->ht[h];
-  while( np ){
-    if( strcmp(np->key,key)==0 ) break;
-    np = np->next;
+  if( p==0 ) return 0;
+  h = strhash(key);
+  mask = p->size - 1;
+  for(j=h&mask; (e=p->aSlot[j])!=0; j=(j+1)&mask){
+    if( p->aHash[e-1]==h && strcmp((const char*)p->aKey[e-1],key)==0 ){
+      return (struct symbol*)p->aData[e-1];
+    }
   }
-  return np ? np->data : 0;
+  return 0;
 }
 
 /* Return the n-th data.  Return NULL if n is out of range. */
@@ -6135,7 +8184,7 @@ struct symbol *Symbol_Nth(struct lemon *lem, int n)
 {
   struct symbol *data;
   if( lem->x2a && n>0 && n<=lem->x2a->count ){
-    data = lem->x2a->tbl[n-1].data;
+    data = (struct symbol*)lem->x2a->aData[n-1];
   }else{
     data = 0;
   }
@@ -6153,15 +8202,7 @@ int Symbol_count(struct lemon *lem)
 ** problems, or if the array is empty. */
 struct symbol **Symbol_arrayof(struct lemon *lem)
 {
-  struct symbol **array;
-  int i,arrSize;
-  if( lem->x2a==0 ) return 0;
-  arrSize = lem->x2a->count;
-  array = (struct symbol **)calloc(arrSize, sizeof(struct symbol *));
-  if( array ){
-    for(i=0; i<arrSize; i++) array[i] = lem->x2a->tbl[i].data;
-  }
-  return array;
+  return (struct symbol**)Htable_arrayof(lem->x2a, sizeof(struct symbol*));
 }
 
 /* Compare two configurations */
@@ -6193,144 +8234,56 @@ PRIVATE int statecmp(struct config *a, struct config *b)
 /* Hash a state */
 PRIVATE unsigned statehash(struct config *a)
 {
-  unsigned h=0;
+  unsigned long long h = HASH_P0;
   while( a ){
-    h = h*571 + a->rp->index*37 + a->dot;
+    h = hash_mum(h ^ (((unsigned long long)a->rp->index<<32) | a->dot),
+                 HASH_P1);
     a = a->bp;
   }
-  return h;
+  return HASH_FOLD(hash_mum(h^HASH_P2, HASH_P1));
 }
 
 /* Allocate a new state structure */
-struct state *State_new()
+struct state *State_new(struct lemon *lemp)
 {
-  struct state *newstate;
-  newstate = (struct state *)calloc(1, sizeof(struct state) );
-  MemoryCheck(newstate);
-  return newstate;
+  return (struct state *)Arena_alloc(lemp, sizeof(struct state));
 }
 
-/* There is one instance of the following structure for each
-** associative array of type "x3".
-*/
-struct s_x3 {
-  int size;               /* The number of available slots. */
-                          /*   Must be a power of 2 greater than or */
-                          /*   equal to 1 */
-  int count;              /* Number of currently slots filled */
-  struct s_x3node *tbl;  /* The data stored here */
-  struct s_x3node **ht;  /* Hash table for lookups */
-};
-
-/* There is one instance of this structure for every data element
-** in an associative array of type "x3".
-*/
-typedef struct s_x3node {
-  struct state *data;                  /* The data */
-  struct config *key;                   /* The key */
-  struct s_x3node *next;   /* Next entry with the same hash */
-  struct s_x3node **from;  /* Previous link */
-} x3node;
-
 /* Allocate a new associative array */
 void State_init(struct lemon *lem){
   if( lem->x3a ) return;
-  lem->x3a = (struct s_x3*)malloc( sizeof(struct s_x3) );
-  if( lem->x3a ){
-    lem->x3a->size = 128;
-    lem->x3a->count = 0;
-    lem->x3a->tbl = (x3node*)calloc(128, sizeof(x3node) + sizeof(x3node*));
-    if( lem->x3a->tbl==0 ){
-      free(lem->x3a);
-      lem->x3a = 0;
-    }else{
-      int i;
-      lem->x3a->ht = (x3node**)&(lem->x3a->tbl[128]);
-      for(i=0; i<128; i++) lem->x3a->ht[i] = 0;
-    }
-  }
+  lem->x3a = Htable_new(128);
 }
 void State_deinit(struct lemon *lemp){
-    if(lemp->x3a) {
-        for(int i=0, imax=lemp->x3a->count; i < imax; ++i) {
-            free(lemp->x3a->tbl[i].data);
-        }
-        free(lemp->x3a->tbl);
-        free(lemp->x3a);
-    }
+    /* The states themselves belong to the arena */
+    Htable_free(lemp->x3a);
+    lemp->x3a = 0;
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
 int State_insert(struct lemon *lem, struct state *data, struct config *key)
 {
-  x3node *np;
-  unsigned h;
-  unsigned ph;
-
   if( lem->x3a==0 ) return 0;
-  ph = statehash(key);
-  h = ph & (lem->x3a->size-1);
-  np = lem->x3a->ht[h];
-  while( np ){
-    if( statecmp(np->key,key)==0 ){
-      /* An existing entry with the same key is found. */
-      /* Fail because overwrite is not allows. */
-      return 0;
-    }
-    np = np->next;
-  }
-  if( lem->x3a->count>=lem->x3a->size ){
-    /* Need to make the hash table bigger */
-    int i,arrSize;
-    struct s_x3 array;
-    array.size = arrSize = lem->x3a->size*2;
-    array.count = lem->x3a->count;
-    array.tbl = (x3node*)calloc(arrSize, sizeof(x3node) + sizeof(x3node*));
-    if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
-    array.ht = (x3node**)&(array.tbl[arrSize]);
-    for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<lem->x3a->count; i++){
-      x3node *oldnp, *newnp;
-      oldnp = &(lem->x3a->tbl[i]);
-      h = statehash(oldnp->key) & (arrSize-1);
-      newnp = &(array.tbl[i]);
-      if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
-      newnp->next = array.ht[h];
-      newnp->key = oldnp->key;
-      newnp->data = oldnp->data;
-      newnp->from = &(array.ht[h]);
-      array.ht[h] = newnp;
-    }
-    free(lem->x3a->tbl);
-    *lem->x3a = array;
-  }
-  /* Insert the new data */
-  h = ph & (lem->x3a->size-1);
-  np = &(lem->x3a->tbl[lem->x3a->count++]);
-  np->key = key;
-  np->data = data;
-  if( lem->x3a->ht[h] ) lem->x3a->ht[h]->from = &(np->next);
-  np->next = lem->x3a->ht[h];
-  lem->x3a->ht[h] = np;
-  np->from = &(lem->x3a->ht[h]);
-  return 1;
+  if( State_find(lem, key) ) return 0;
+  return Htable_append(lem->x3a, data, key, statehash(key));
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
 struct state *State_find(struct lemon *lem, struct config *key)
 {
-  unsigned h;
-  x3node *np;
+  struct s_htable *p = lem->x3a;
+  unsigned h, mask, j, e;
 
-  if( lem->x3a==0 ) return 0;
-  h = statehash(key) & (lem->x3a->size-1);
-  np = lem->x3a->ht[h];
-  while( np ){
-    if( statecmp(np->key,key)==0 ) break;
-    np = np->next;
+  if( p==0 ) return 0;
+  h = statehash(key);
+  mask = p->size - 1;
+  for(j=h&mask; (e=p->aSlot[j])!=0; j=(j+1)&mask){
+    if( p->aHash[e-1]==h && statecmp((struct config*)p->aKey[e-1],key)==0 ){
+      return (struct state*)p->aData[e-1];
+    }
   }
-  return np ? np->data : 0;
+  return 0;
 }
 
 /* Return an array of pointers to all data in the table.
@@ -6338,157 +8291,402 @@ struct state *State_find(struct lemon *lem, struct config *key)
 ** problems, or if the array is empty. */
 struct state **State_arrayof(struct lemon *lem)
 {
-  struct state **array;
-  int i,arrSize;
-  if( lem->x3a==0 ) return 0;
-  arrSize = lem->x3a->count;
-  array = (struct state **)calloc(arrSize, sizeof(struct state *));
-  if( array ){
-    for(i=0; i<arrSize; i++) array[i] = lem->x3a->tbl[i].data;
-  }
-  return array;
+  return (struct state**)Htable_arrayof(lem->x3a, sizeof(struct state*));
 }
 
 /* Hash a configuration */
 PRIVATE unsigned confighash(struct config *a)
 {
-  unsigned h=0;
-  h = h*571 + a->rp->index*37 + a->dot;
-  return h;
+  unsigned long long h;
+  h = hash_mum(((unsigned long long)a->rp->index<<32 | a->dot) ^ HASH_P0,
+               HASH_P1);
+  return HASH_FOLD(h);
 }
 
-/* There is one instance of the following structure for each
-** associative array of type "x4".
-*/
-struct s_x4 {
-  int size;               /* The number of available slots. */
-                          /*   Must be a power of 2 greater than or */
-                          /*   equal to 1 */
-  int count;              /* Number of currently slots filled */
-  struct s_x4node *tbl;  /* The data stored here */
-  struct s_x4node **ht;  /* Hash table for lookups */
-};
-
-/* There is one instance of this structure for every data element
-** in an associative array of type "x4".
-*/
-typedef struct s_x4node {
-  struct config *data;                  /* The data */
-  struct s_x4node *next;   /* Next entry with the same hash */
-  struct s_x4node **from;  /* Previous link */
-} x4node;
-
 /* Allocate a new associative array */
 void Configtable_init(struct lemon *lem){
   if( lem->x4a ) return;
-  lem->x4a = (struct s_x4*)malloc( sizeof(struct s_x4) );
-  if( lem->x4a ){
-    lem->x4a->size = 64;
-    lem->x4a->count = 0;
-    lem->x4a->tbl = (x4node*)calloc(64, sizeof(x4node) + sizeof(x4node*));
-    if( lem->x4a->tbl==0 ){
-      free(lem->x4a);
-      lem->x4a = 0;
-    }else{
-      int i;
-      lem->x4a->ht = (x4node**)&(lem->x4a->tbl[64]);
-      for(i=0; i<64; i++) lem->x4a->ht[i] = 0;
-    }
-  }
+  lem->x4a = Htable_new(64);
 }
 void Configtable_deinit(struct lemon *lemp){
-    if( lemp->x4a ) {
-        for(int i=0, imax=lemp->x4a->count; i < imax; ++i) {
-            if(lemp->x4a->tbl[i].data) {
-                free(lemp->x4a->tbl[i].data);
-            }
-        }
-        free(lemp->x4a->tbl);
-        free(lemp->x4a);
-    }
+    /* The configurations themselves belong to the arena */
+    Htable_free(lemp->x4a);
+    lemp->x4a = 0;
 }
 /* Insert a new record into the array.  Return TRUE if successful.
 ** Prior data with the same key is NOT overwritten */
 int Configtable_insert(struct lemon *lem, struct config *data)
 {
-  x4node *np;
-  unsigned h;
-  unsigned ph;
-
   if( lem->x4a==0 ) return 0;
-  ph = confighash(data);
-  h = ph & (lem->x4a->size-1);
-  np = lem->x4a->ht[h];
-  while( np ){
-    if( Configcmp((const char *) np->data,(const char *) data)==0 ){
-      /* An existing entry with the same key is found. */
-      /* Fail because overwrite is not allows. */
-      return 0;
-    }
-    np = np->next;
-  }
-  if( lem->x4a->count>=lem->x4a->size ){
-    /* Need to make the hash table bigger */
-    int i,arrSize;
-    struct s_x4 array;
-    array.size = arrSize = lem->x4a->size*2;
-    array.count = lem->x4a->count;
-    array.tbl = (x4node*)calloc(arrSize, sizeof(x4node) + sizeof(x4node*));
-    if( array.tbl==0 ) return 0;  /* Fail due to malloc failure */
-    array.ht = (x4node**)&(array.tbl[arrSize]);
-    for(i=0; i<arrSize; i++) array.ht[i] = 0;
-    for(i=0; i<lem->x4a->count; i++){
-      x4node *oldnp, *newnp;
-      oldnp = &(lem->x4a->tbl[i]);
-      h = confighash(oldnp->data) & (arrSize-1);
-      newnp = &(array.tbl[i]);
-      if( array.ht[h] ) array.ht[h]->from = &(newnp->next);
-      newnp->next = array.ht[h];
-      newnp->data = oldnp->data;
-      newnp->from = &(array.ht[h]);
-      array.ht[h] = newnp;
-    }
-    /* free(x4a->tbl); // This code was originall written for 16-bit machines.
-    ** on modern machines, don't worry about freeing this trival amount of
-    ** memory. */
-    *lem->x4a = array;
-  }
-  /* Insert the new data */
-  h = ph & (lem->x4a->size-1);
-  np = &(lem->x4a->tbl[lem->x4a->count++]);
-  np->data = data;
-  if( lem->x4a->ht[h] ) lem->x4a->ht[h]->from = &(np->next);
-  np->next = lem->x4a->ht[h];
-  lem->x4a->ht[h] = np;
-  np->from = &(lem->x4a->ht[h]);
-  return 1;
+  if( Configtable_find(lem, data) ) return 0;
+  return Htable_append(lem->x4a, data, data, confighash(data));
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
 struct config *Configtable_find(struct lemon *lem, struct config *key)
 {
-  int h;
-  x4node *np;
+  struct s_htable *p = lem->x4a;
+  unsigned h, mask, j, e;
+  struct config *cfp;
 
-  if( lem->x4a==0 ) return 0;
-  h = confighash(key) & (lem->x4a->size-1);
-  np = lem->x4a->ht[h];
-  while( np ){
-    if( Configcmp((const char *) np->data,(const char *) key)==0 ) break;
-    np = np->next;
+  if( p==0 ) return 0;
+  h = confighash(key);
+  mask = p->size - 1;
+  for(j=h&mask; (e=p->aSlot[j])!=0; j=(j+1)&mask){
+    if( p->aHash[e-1]!=h ) continue;
+    cfp = (struct config*)p->aData[e-1];
+    if( cfp->rp==key->rp && cfp->dot==key->dot ) return cfp;
   }
-  return np ? np->data : 0;
+  return 0;
 }
 
 /* Remove all data from the table.  Pass each data to the function "f"
-** as it is removed.  ("f" may be null to avoid this step.) */
+** as it is removed.  ("f" may be null to avoid this step.)
+**
+** This runs once for every state, so only the slots actually in use are
+** cleared when the table is mostly empty.
+*/
 void Configtable_clear(struct lemon *lem, int(*f)(struct config *))
 {
+  struct s_htable *p = lem->x4a;
+  unsigned mask, j;
   int i;
-  if( lem->x4a==0 || lem->x4a->count==0 ) return;
-  if( f ) for(i=0; i<lem->x4a->count; i++) (*f)(lem->x4a->tbl[i].data);
-  for(i=0; i<lem->x4a->size; i++) lem->x4a->ht[i] = 0;
-  lem->x4a->count = 0;
+  if( p==0 || p->count==0 ) return;
+  if( f ) for(i=0; i<p->count; i++) (*f)((struct config*)p->aData[i]);
+  if( p->count*8<p->size ){
+    mask = p->size - 1;
+    for(i=0; i<p->count; i++){
+      for(j=p->aHash[i]&mask; p->aSlot[j]!=(unsigned)i+1; j=(j+1)&mask){}
+      p->aSlot[j] = 0;
+    }
+  }else{
+    memset(p->aSlot, 0, p->size*sizeof(unsigned));
+  }
+  p->count = 0;
   return;
 }
+
+/***************** From the file "cache.c" **********************************/
+/*
+** The automaton cache of the LEMON parser generator.  With the -C option
+** the finished automaton is saved in a "*.lcache" file next to the other
+** outputs, together with a key that captures every input it was built
+** from.  A later run whose key matches byte for byte loads the states and
+** their actions back and skips FindStates() through ResortStates(), which
+** is nearly all of the time spent on a large grammar.  Whether a rule
+** has C code is part of the key, because CompressTables() optimizes away
+** the reduce of a single-symbol rule that has none.  Editing the code of
+** a rule that already has some, the %include, or the other directives
+** that do not change the tables keeps the cache valid.
+*/
+#define CACHE_MAGIC "lemon automaton cache 2\n"
+#define CACHE_END   0x4c454e44
+
+/* Append n bytes to the key */
+PRIVATE void Cache_put(struct cache_key *k, const void *p, size_t n)
+{
+  if( k->n+n>k->nAlloc ){
+    k->nAlloc = (k->n+n)*2 + 256;
+    k->z = (char*)realloc(k->z, k->nAlloc);
+    MemoryCheck(k->z);
+  }
+  memcpy(k->z+k->n, p, n);
+  k->n += n;
+}
+PRIVATE void Cache_putint(struct cache_key *k, int v)
+{
+  Cache_put(k, &v, sizeof(v));
+}
+PRIVATE void Cache_putstr(struct cache_key *k, const char *z)
+{
+  if( z==0 ){
+    Cache_putint(k, -1);
+  }else{
+    int n = lemonStrlen(z);
+    Cache_putint(k, n);
+    Cache_put(k, z, n);
+  }
+}
+
+/* Compute the key for the grammar in lemp.  This must run after the
+** precedence of every rule is known. */
+void Cache_key(
+  struct lemon *lemp,
+  struct cache_key *k,
+  int compress,            /* True for the -c option */
+  int noResort             /* True for the -r option */
+){
+  int i, j, n;
+  struct symbol *sp;
+  struct rule *rp;
+
+  n = Symbol_count(lemp);
+  Cache_putint(k, (int)sizeof(struct cache_key));
+  Cache_putint(k, compress);
+  Cache_putint(k, noResort);
+  Cache_putint(k, lemp->basisflag);
+  Cache_putint(k, lemp->showPrecedenceConflict);
+  Cache_putint(k, lemp->yaccPrec);
+  Cache_putint(k, lemp->ignorePrec);
+  Cache_putint(k, (int)lemp->laEngine);
+  Cache_putint(k, lemp->nsymbol);
+  Cache_putint(k, lemp->nterminal);
+  Cache_putint(k, n);
+  Cache_putint(k, lemp->nrule);
+  for(i=0; i<n; i++){
+    sp = lemp->symbols[i];
+    Cache_putstr(k, sp->name);
+    Cache_putint(k, (int)sp->type);
+    Cache_putint(k, sp->prec);
+    Cache_putint(k, (int)sp->assoc);
+    if( sp->type==MULTITERMINAL ){
+      Cache_putint(k, sp->nsubsym);
+      for(j=0; j<sp->nsubsym; j++) Cache_putint(k, sp->subsym[j]->index);
+    }
+  }
+  Cache_putint(k, lemp->wildcard ? lemp->wildcard->index : -1);
+  Cache_putint(k, lemp->errsym ? lemp->errsym->index : -1);
+  Cache_putstr(k, lemp->start);
+  for(rp=lemp->rule; rp; rp=rp->next){
+    Cache_putint(k, rp->index);
+    Cache_putint(k, rp->iRule);
+    Cache_putint(k, rp->lhs->index);
+    Cache_putint(k, rp->nrhs);
+    for(j=0; j<rp->nrhs; j++) Cache_putint(k, rp->rhs[j]->index);
+    Cache_putint(k, rp->precsym ? rp->precsym->index : -1);
+    Cache_putint(k, rp->noCode);
+  }
+}
+
+/* The fingerprint of a key, checked before the key itself is compared */
+PRIVATE unsigned long long Cache_fingerprint(struct cache_key *k)
+{
+  unsigned long long h = HASH_P0 ^ k->n;
+  unsigned long long a, b;
+  unsigned char tail[16];
+  size_t i;
+  for(i=0; i+16<=k->n; i+=16){
+    memcpy(&a, k->z+i, 8);
+    memcpy(&b, k->z+i+8, 8);
+    h = hash_mum(a^HASH_P1, b^h);
+  }
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, k->z+i, k->n-i);
+  memcpy(&a, tail, 8);
+  memcpy(&b, tail+8, 8);
+  h = hash_mum(a^HASH_P1, b^h);
+  return hash_mum(h^HASH_P2, HASH_P1);
+}
+
+/* The value of a saved action that identifies its target, or -1.  Only
+** the actions that reach the generated tables are saved. */
+PRIVATE int Cache_target(struct action *ap)
+{
+  switch( ap->type ){
+    case SHIFT:        return ap->x.stp->statenum;
+    case SHIFTREDUCE:
+    case REDUCE:       return ap->x.rp->iRule;
+    case ERROR:
+    case ACCEPT:       return -1;
+    default:           return -2;
+  }
+}
+
+/* Save the automaton of lemp under the key k.  A cache that cannot be
+** written is only worth a warning. */
+void Cache_save(struct lemon *lemp, struct cache_key *k)
+{
+  char *zName = file_makename(lemp, ".lcache");
+  FILE *fp;
+  unsigned long long h;
+  size_t nReport = 0;
+  long iReport, iEnd;
+  int i, n, a[6];
+  struct state *stp;
+  struct action *ap;
+
+  fp = fopen(zName, "wb");
+  if( fp==0 ){
+    fprintf(stderr,"Can't open file \"%s\".\n", zName);
+    free(zName);
+    return;
+  }
+  h = Cache_fingerprint(k);
+  fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC)-1, fp);
+  fwrite(&h, sizeof(h), 1, fp);
+  fwrite(&k->n, sizeof(k->n), 1, fp);
+  fwrite(k->z, 1, k->n, fp);
+  a[0] = lemp->nstate;
+  a[1] = lemp->nxstate;
+  a[2] = lemp->nconflict;
+  a[3] = lemp->nconflict_sr;
+  a[4] = lemp->nconflict_rr;
+  fwrite(a, sizeof(a[0]), 5, fp);
+  for(i=0; i<lemp->nxstate; i++){
+    stp = lemp->sorted[i];
+    for(n=0, ap=stp->ap; ap; ap=ap->next){
+      if( Cache_target(ap)>=-1 ) n++;
+    }
+    a[0] = stp->nTknAct;
+    a[1] = stp->nNtAct;
+    a[2] = stp->iTknOfst;
+    a[3] = stp->iNtOfst;
+    a[4] = stp->iDfltReduce;
+    a[5] = n;
+    fwrite(a, sizeof(a[0]), 6, fp);
+    for(ap=stp->ap; ap; ap=ap->next){
+      a[2] = Cache_target(ap);
+      if( a[2]<-1 ) continue;
+      a[0] = (int)ap->type;
+      a[1] = ap->sp->index;
+      fwrite(a, sizeof(a[0]), 3, fp);
+    }
+  }
+
+  /* The states section of the report follows, preceded by its size */
+  iReport = ftell(fp);
+  fwrite(&nReport, sizeof(nReport), 1, fp);
+  ReportStates(lemp, fp);
+  iEnd = ftell(fp);
+  nReport = iEnd - iReport - sizeof(nReport);
+  fseek(fp, iReport, SEEK_SET);
+  fwrite(&nReport, sizeof(nReport), 1, fp);
+  fseek(fp, iEnd, SEEK_SET);
+  a[0] = CACHE_END;
+  fwrite(a, sizeof(a[0]), 1, fp);
+  if( ferror(fp) | fclose(fp) ){
+    fprintf(stderr,"Can't write file \"%s\".\n", zName);
+    remove(zName);
+  }
+  free(zName);
+}
+
+/* Read n bytes from the cache.  Return false on a short read. */
+PRIVATE int Cache_get(FILE *fp, void *p, size_t n)
+{
+  return fread(p, 1, n, fp)==n;
+}
+
+/* Load the automaton saved under the key k into lemp.  Return true on
+** success.  Anything that does not check out, down to a truncated file,
+** is treated as a miss and leaves lemp as it was. */
+int Cache_load(struct lemon *lemp, struct cache_key *k)
+{
+  char *zName = file_makename(lemp, ".lcache");
+  FILE *fp;
+  char zMagic[sizeof(CACHE_MAGIC)-1];
+  char *zKey = 0;
+  char *zReport = 0;
+  struct state *aState;
+  struct state **sorted = 0;
+  struct rule **aRule = 0;
+  struct rule *rp;
+  struct action *ap, **ppAp;
+  unsigned long long h;
+  size_t nKey, nReport;
+  int i, j, nAct, ok, a[6];
+
+  fp = fopen(zName, "rb");
+  free(zName);
+  if( fp==0 ) return 0;
+  ok = Cache_get(fp, zMagic, sizeof(zMagic))
+    && memcmp(zMagic, CACHE_MAGIC, sizeof(zMagic))==0
+    && Cache_get(fp, &h, sizeof(h)) && h==Cache_fingerprint(k)
+    && Cache_get(fp, &nKey, sizeof(nKey)) && nKey==k->n;
+  if( ok ){
+    zKey = (char*)malloc( nKey+1 );
+    MemoryCheck(zKey);
+    ok = Cache_get(fp, zKey, nKey) && memcmp(zKey, k->z, nKey)==0;
+    free(zKey);
+  }
+  ok = ok && Cache_get(fp, a, sizeof(a[0])*5)
+    && a[0]>0 && a[1]>=0 && a[1]<=a[0]
+    && a[2]>=0 && a[3]>=0 && a[4]>=0;
+  if( !ok ){
+    fclose(fp);
+    return 0;
+  }
+
+  /* Rebuild just enough of every state for ReportTable() */
+  aState = (struct state*)Arena_alloc(lemp, sizeof(struct state)*a[0]);
+  sorted = (struct state**)calloc(a[0], sizeof(sorted[0]));
+  aRule = (struct rule**)calloc(lemp->nrule+1, sizeof(aRule[0]));
+  MemoryCheck(sorted);
+  MemoryCheck(aRule);
+  lemp->nstate = a[0];
+  lemp->nxstate = a[1];
+  lemp->nconflict = a[2];
+  lemp->nconflict_sr = a[3];
+  lemp->nconflict_rr = a[4];
+  for(i=0; i<lemp->nstate; i++){
+    sorted[i] = &aState[i];
+    aState[i].statenum = i;
+    aState[i].iTknOfst = NO_OFFSET;
+    aState[i].iNtOfst = NO_OFFSET;
+    aState[i].iDfltReduce = -1;
+  }
+  for(rp=lemp->rule; rp; rp=rp->next){
+    if( rp->iRule>=0 && rp->iRule<lemp->nrule ) aRule[rp->iRule] = rp;
+  }
+  for(i=0; ok && i<lemp->nxstate; i++){
+    ok = Cache_get(fp, a, sizeof(a[0])*6)
+      && a[4]>=-1 && a[4]<lemp->nrule && a[5]>=0;
+    if( !ok ) break;
+    aState[i].nTknAct = a[0];
+    aState[i].nNtAct = a[1];
+    aState[i].iTknOfst = a[2];
+    aState[i].iNtOfst = a[3];
+    aState[i].iDfltReduce = a[4];
+    nAct = a[5];
+    ppAp = &aState[i].ap;
+    for(j=0; ok && j<nAct; j++){
+      ok = Cache_get(fp, a, sizeof(a[0])*3)
+        && a[1]>=0 && a[1]<=lemp->nsymbol;
+      if( !ok ) break;
+      ap = (struct action*)Arena_alloc(lemp, sizeof(struct action));
+      ap->type = (enum e_action)a[0];
+      ap->sp = lemp->symbols[a[1]];
+      switch( ap->type ){
+        case SHIFT:
+          ok = a[2]>=0 && a[2]<lemp->nstate;
+          if( ok ) ap->x.stp = &aState[a[2]];
+          break;
+        case SHIFTREDUCE:
+        case REDUCE:
+          ok = a[2]>=0 && a[2]<lemp->nrule && aRule[a[2]]!=0;
+          if( ok ) ap->x.rp = aRule[a[2]];
+          break;
+        case ERROR:
+        case ACCEPT:
+          break;
+        default:
+          ok = 0;
+          break;
+      }
+      *ppAp = ap;
+      ppAp = &ap->next;
+    }
+  }
+  ok = ok && Cache_get(fp, &nReport, sizeof(nReport)) && nReport<((size_t)1<<40);
+  if( ok ){
+    zReport = (char*)malloc( nReport+1 );
+    MemoryCheck(zReport);
+    ok = Cache_get(fp, zReport, nReport)
+      && Cache_get(fp, a, sizeof(a[0])) && a[0]==CACHE_END
+      && fgetc(fp)==EOF;
+  }
+  fclose(fp);
+  free(aRule);
+  if( !ok ){
+    free(sorted);
+    free(zReport);
+    lemp->nstate = lemp->nxstate = 0;
+    lemp->nconflict = lemp->nconflict_sr = lemp->nconflict_rr = 0;
+    return 0;
+  }
+  lemp->sorted = sorted;
+  lemp->zStateReport = zReport;
+  lemp->nStateReport = nReport;
+  return 1;
+}
@@ -43,6 +43,12 @@
 **                       values which should be used if the original symbol
 **                       would not parse.  This permits keywords to sometimes
 **                       be used as identifiers, for example.
+**    YYRESOLVEDFALLBACK If defined (by the -F option of lemon), the action
+**                       tables already hold the actions that fallbacks and
+**                       the wildcard lead to, so they are not searched for
+**                       when a lookahead misses.  Such a lookahead is not
+**                       traced, but YYSTATS and YYTRACERING still count
+**                       and record it, from the yy_resolved[] table.
 **    YYACTIONTYPE       is the data type used for "action codes" - numbers
 **                       that indicate what to do in response to the next
 **                       token.
@@ -101,6 +107,18 @@
 # define yytestcase(X)
 #endif
 
+/* Lemon aligns the yy_action[] and yy_lookahead[] tables of a parser
+** that was laid out from a profile (the -G option) on cache lines using
+** the following macro.
+*/
+#ifndef YYALIGNED
+# if defined(__GNUC__)
+#  define YYALIGNED(N) __attribute__((aligned(N)))
+# else
+#  define YYALIGNED(N)
+# endif
+#endif
+
 
 /* Next are the tables used to determine what action to take based on the
 ** current state and lookahead token.  These tables are used to implement
@@ -150,6 +168,17 @@
 **  yy_reduce_ofst[]   For each state, the offset into yy_action for
 **                     shifting non-terminals after a reduce.
 **  yy_default[]       Default action for each state.
+**  yy_resolved[]      With -F, and only for YYSTATS or YYTRACERING, two
+**                     bits for each state S and terminal X, at bit
+**                     2*(S*YYNTOKEN+X): 1 if X took its fallback in S,
+**                     and 2 if it then took the wildcard.
+**
+** If lemon is run with the -k option, YYCODEDACTIONS is defined and the
+** first four tables are replaced by two functions made of switch
+** statements, yy_coded_shift_action() and yy_coded_reduce_action().
+** Each returns the action for state S and lookahead X, or YY_NO_ACTION
+** where formula (B) applies.  The tables are then only compiled for
+** YYCOVERAGE.
 **
 *********** Begin parsing tables **********************************************/
 %%
@@ -190,16 +219,102 @@ static const YYCODETYPE yyFallback[] = {
 ** After the "shift" half of a SHIFTREDUCE action, the stateno field
 ** actually contains the reduce action for the second half of the
 ** SHIFTREDUCE.
+**
+** If lemon is run with the -V option, YYSTACKSPLIT is defined and the
+** semantic values are kept apart in the yyvstack[] array, at the same
+** index as their stack entry.  Then the states and major tokens are
+** dense, and a reduce only touches values for rules that have code.
 */
 struct yyStackEntry {
   YYACTIONTYPE stateno;  /* The state-number, or reduce action in SHIFTREDUCE */
   YYCODETYPE major;      /* The major token value.  This is the code
                          ** number for the token at this stack level */
+#ifndef YYSTACKSPLIT
   YYMINORTYPE minor;     /* The user-supplied minor token value.  This
                          ** is the value of the token  */
+#endif
 };
 typedef struct yyStackEntry yyStackEntry;
 
+/* A pointer to the semantic value of stack entry E of parser P, and the
+** number of bytes that each level of the stack takes up.  When the values
+** and the entries share one block of memory, the values go first.  The
+** entries then need no padding, as YYMINORTYPE holds an int and so is
+** aligned at least as strictly as they are. */
+#ifdef YYSTACKSPLIT
+# define yyStackValue(P,E)  (&(P)->yyvstack[(E)-(P)->yystack])
+# define YYSTACKENTRYSIZE   (sizeof(yyStackEntry)+sizeof(YYMINORTYPE))
+#else
+# define yyStackValue(P,E)  (&(E)->minor)
+# define YYSTACKENTRYSIZE   sizeof(yyStackEntry)
+#endif
+
+/* If YYTRACERING is defined, each parser records its recent shifts,
+** reduces, fallbacks and syntax errors as events in a ring of the last
+** YYTRACERING events, which must be a power of two.  Recording an event
+** is a few stores, so the ring can be left on in production and saved
+** with ParseTraceRingSave() when a parse goes wrong.
+** ParseTraceRingDecode() in a build without NDEBUG renders saved rings.
+*/
+#ifdef YYTRACERING
+#define YYEV_SHIFT     1   /* iSymbol shifted, iState is the new state */
+#define YYEV_REDUCE    2   /* Rule iArg reduced to iSymbol, go to iState */
+#define YYEV_FALLBACK  3   /* iSymbol falls back in state iState */
+#define YYEV_WILDCARD  4   /* iSymbol matches the wildcard in iState */
+#define YYEV_ERROR     5   /* Syntax error on iSymbol in state iState */
+#define YYEV_ACCEPT    6   /* The parse is accepted */
+typedef struct yyTraceEvent yyTraceEvent;
+struct yyTraceEvent {
+  unsigned char eType;   /* One of the YYEV_ codes */
+  YYCODETYPE iSymbol;    /* The token or nonterminal */
+  YYACTIONTYPE iState;   /* A state number or action */
+  YYACTIONTYPE iArg;     /* The rule of a YYEV_REDUCE */
+};
+#define yyRecordEvent(P,E,X,S,A) do{ \
+  yyTraceEvent *yyev = &(P)->yyring[(P)->yyringpos++ & (YYTRACERING-1)]; \
+  yyev->eType = (E); \
+  yyev->iSymbol = (YYCODETYPE)(X); \
+  yyev->iState = (YYACTIONTYPE)(S); \
+  yyev->iArg = (YYACTIONTYPE)(A); \
+}while(0)
+#else
+# define yyRecordEvent(P,E,X,S,A)
+#endif
+
+/* If YYSTATS is defined, each parser counts what it does, to show which
+** rules and states dominate a workload.  ParseStats() reports and resets
+** the counts, and ParseGetStats() hands them to the caller.  Stack depths
+** of YYSTATSDEPTH-1 and more share the last bucket of the depth histogram.
+*/
+#ifdef YYSTATS
+#ifndef YYSTATSDEPTH
+# define YYSTATSDEPTH 64
+#endif
+typedef struct yyStats yyStats;
+struct yyStats {
+  unsigned long nShift;          /* Tokens shifted, the error token too */
+  unsigned long nShiftReduce;    /* Shifts that were SHIFTREDUCE actions */
+  unsigned long nDefaultReduce;  /* Lookaheads missed, default was a reduce */
+  unsigned long nFallback;       /* Lookaheads that took their fallback */
+  unsigned long nSyntaxError;    /* Syntax errors, reported or not */
+  unsigned long nRecovery;       /* Shifts of the error token */
+  unsigned long aRule[YYNRULE];  /* Reductions by each rule */
+  unsigned long aDepth[YYSTATSDEPTH];  /* Shifts at each stack depth */
+};
+# define yyStatsIncr(P,F)  ((P)->yystats.F++)
+#else
+# define yyStatsIncr(P,F)
+#endif
+
+/* yy_find_shift_action() needs the parser to record events or counts */
+#if defined(YYTRACERING) || defined(YYSTATS)
+# define YYFINDPDECL  ,yyParser *yypParser
+# define YYFINDPARAM  ,yypParser
+#else
+# define YYFINDPDECL
+# define YYFINDPARAM
+#endif
+
 /* The state of the parser is completely contained in an instance of
 ** the following structure */
 struct yyParser {
@@ -212,18 +327,40 @@ struct yyParser {
 #endif
   ParseARG_SDECL                /* A place to hold %extra_argument */
   ParseCTX_SDECL                /* A place to hold %extra_context */
+#ifdef YYTRACERING
+  unsigned int yyringpos;       /* Number of events recorded in yyring[] */
+  yyTraceEvent yyring[YYTRACERING];  /* The most recent events */
+#endif
+#ifdef YYSTATS
+  yyStats yystats;              /* Counts of what the parser did */
+#endif
 #if YYSTACKDEPTH<=0
   int yystksz;                  /* Current side of the stack */
   yyStackEntry *yystack;        /* The parser's stack */
+  yyStackEntry *yystkBase;      /* Stack memory not from the heap */
+  int (*yyxOverflow)(void*,int);/* Called when yystkBase is full */
+  void *yyOverflowArg;          /* First argument to yyxOverflow */
   yyStackEntry yystk0;          /* First stack entry */
+#ifdef YYSTACKSPLIT
+  YYMINORTYPE *yyvstack;        /* Semantic values of yystack[] */
+  YYMINORTYPE yyvstk0;          /* First semantic value */
+#endif
 #else
   yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
   yyStackEntry *yystackEnd;            /* Last entry in the stack */
+#ifdef YYSTACKSPLIT
+  YYMINORTYPE yyvstack[YYSTACKDEPTH];  /* Semantic values of yystack[] */
+#endif
 #endif
 };
 typedef struct yyParser yyParser;
 
 #include <assert.h>
+#include <stddef.h>
+#ifdef YYSTATS
+#include <stdio.h>
+#include <string.h>
+#endif
 #ifndef NDEBUG
 #include <stdio.h>
 static FILE *yyTraceFILE = 0;
@@ -274,23 +411,74 @@ static const char *const yyRuleName[] = {
 
 
 #if YYSTACKDEPTH<=0
+/* The growth policy of the parser stack.  Each time the stack fills up
+** it grows to YYSTACKGROWTH times its size plus 100 entries, but never
+** beyond YYSTACKLIMIT entries if that is more than zero.  A stack that
+** cannot grow any further is a stack overflow.  These can be changed by
+** putting an appropriate #define in the %include section of the input
+** grammar.
+*/
+#ifndef YYSTACKGROWTH
+# define YYSTACKGROWTH 2
+#endif
+#ifndef YYSTACKLIMIT
+# define YYSTACKLIMIT 0
+#endif
+
 /*
 ** Try to increase the size of the parser stack.  Return the number
 ** of errors.  Return 0 on success.
+**
+** A stack in yystk0 or in a buffer given to ParseInitWithBuffer() is
+** copied to the heap.  For the buffer, the overflow callback is asked
+** first, and a non-zero return from it is an error.
 */
 static int yyGrowStack(yyParser *p){
   int newSize;
-  int idx;
+  int idx, i;
   yyStackEntry *pNew;
+#ifdef YYSTACKSPLIT
+  YYMINORTYPE *pNewV;
+#endif
 
-  newSize = p->yystksz*2 + 100;
+  if( YYSTACKLIMIT>0 && p->yystksz>=YYSTACKLIMIT ) return 1;
+  if( p->yystack==p->yystkBase && p->yyxOverflow
+   && p->yyxOverflow(p->yyOverflowArg, p->yystksz) ){
+    return 1;
+  }
+  newSize = p->yystksz*YYSTACKGROWTH + 100;
+  if( YYSTACKLIMIT>0 && newSize>YYSTACKLIMIT ) newSize = YYSTACKLIMIT;
   idx = p->yytos ? (int)(p->yytos - p->yystack) : 0;
-  if( p->yystack==&p->yystk0 ){
+#ifdef YYSTACKSPLIT
+  if( p->yystack==p->yystkBase ){
     pNew = malloc(newSize*sizeof(pNew[0]));
-    if( pNew ) pNew[0] = p->yystk0;
+    pNewV = malloc(newSize*sizeof(pNewV[0]));
+    if( pNew==0 || pNewV==0 ){
+      free(pNew);
+      free(pNewV);
+      return 1;
+    }
+    for(i=0; i<=idx && i<p->yystksz; i++){
+      pNew[i] = p->yystack[i];
+      pNewV[i] = p->yyvstack[i];
+    }
   }else{
+    pNewV = realloc(p->yyvstack, newSize*sizeof(pNewV[0]));
+    if( pNewV==0 ) return 1;
+    p->yyvstack = pNewV;
     pNew = realloc(p->yystack, newSize*sizeof(pNew[0]));
   }
+  if( pNew ) p->yyvstack = pNewV;
+#else
+  if( p->yystack==p->yystkBase ){
+    pNew = malloc(newSize*sizeof(pNew[0]));
+    if( pNew ){
+      for(i=0; i<=idx && i<p->yystksz; i++) pNew[i] = p->yystack[i];
+    }
+  }else{
+    pNew = realloc(p->yystack, newSize*sizeof(pNew[0]));
+  }
+#endif
   if( pNew ){
     p->yystack = pNew;
     p->yytos = &p->yystack[idx];
@@ -323,13 +511,29 @@ void ParseInit(void *yypRawParser ParseCTX_PDECL){
 #ifdef YYTRACKMAXSTACKDEPTH
   yypParser->yyhwm = 0;
 #endif
+#ifdef YYTRACERING
+  assert( (YYTRACERING & (YYTRACERING-1))==0 );
+  yypParser->yyringpos = 0;
+#endif
+#ifdef YYSTATS
+  memset(&yypParser->yystats, 0, sizeof(yypParser->yystats));
+#endif
 #if YYSTACKDEPTH<=0
   yypParser->yytos = NULL;
   yypParser->yystack = NULL;
   yypParser->yystksz = 0;
+  yypParser->yystkBase = &yypParser->yystk0;
+  yypParser->yyxOverflow = 0;
+  yypParser->yyOverflowArg = 0;
+#ifdef YYSTACKSPLIT
+  yypParser->yyvstack = NULL;
+#endif
   if( yyGrowStack(yypParser) ){
     yypParser->yystack = &yypParser->yystk0;
     yypParser->yystksz = 1;
+#ifdef YYSTACKSPLIT
+    yypParser->yyvstack = &yypParser->yyvstk0;
+#endif
   }
 #endif
 #ifndef YYNOERRORRECOVERY
@@ -343,6 +547,57 @@ void ParseInit(void *yypRawParser ParseCTX_PDECL){
 #endif
 }
 
+#if YYSTACKDEPTH<=0
+/* Initialize a new parser that has already been allocated, using the
+** nBuf bytes at pBuf as its stack.  pBuf must be aligned like memory
+** from malloc() and must outlive the parser; it is never freed.  With
+** YYSTACKSPLIT the semantic values go at the start of pBuf.  If the
+** buffer fills up, xOverflow(pArg, nEntry) is invoked, where nEntry is the
+** number of stack entries the buffer holds.  If xOverflow is NULL or
+** returns 0, the stack moves to the heap and grows from there.  Otherwise
+** the parse fails with a stack overflow.
+*/
+void ParseInitWithBuffer(
+  void *yypRawParser,            /* The parser */
+  void *pBuf,                    /* Memory for the stack */
+  size_t nBuf,                   /* Bytes of memory at pBuf */
+  int (*xOverflow)(void*,int),   /* Called when pBuf is full, or NULL */
+  void *pArg                     /* First argument to xOverflow */
+  ParseCTX_PDECL
+){
+  yyParser *yypParser = (yyParser*)yypRawParser;
+  if( pBuf==0 || nBuf<YYSTACKENTRYSIZE ){
+    ParseInit(yypRawParser ParseCTX_PARAM);
+  }else{
+    ParseCTX_STORE
+#ifdef YYTRACKMAXSTACKDEPTH
+    yypParser->yyhwm = 0;
+#endif
+#ifdef YYTRACERING
+    yypParser->yyringpos = 0;
+#endif
+#ifdef YYSTATS
+    memset(&yypParser->yystats, 0, sizeof(yypParser->yystats));
+#endif
+    yypParser->yystksz = (int)(nBuf/YYSTACKENTRYSIZE);
+#ifdef YYSTACKSPLIT
+    yypParser->yyvstack = (YYMINORTYPE*)pBuf;
+    pBuf = (YYMINORTYPE*)pBuf + yypParser->yystksz;
+#endif
+    yypParser->yystack = (yyStackEntry*)pBuf;
+    yypParser->yystkBase = yypParser->yystack;
+#ifndef YYNOERRORRECOVERY
+    yypParser->yyerrcnt = -1;
+#endif
+    yypParser->yytos = yypParser->yystack;
+    yypParser->yystack[0].stateno = 0;
+    yypParser->yystack[0].major = 0;
+  }
+  yypParser->yyxOverflow = xOverflow;
+  yypParser->yyOverflowArg = pArg;
+}
+#endif /* YYSTACKDEPTH<=0 */
+
 #ifndef Parse_ENGINEALWAYSONSTACK
 /* 
 ** This function allocates a new parser.
@@ -418,7 +673,7 @@ static void yy_pop_parser_stack(yyParser *pParser){
       yyTokenName[yytos->major]);
   }
 #endif
-  yy_destructor(pParser, yytos->major, &yytos->minor);
+  yy_destructor(pParser, yytos->major, yyStackValue(pParser, yytos));
 }
 
 /*
@@ -428,8 +683,176 @@ void ParseFinalize(void *p){
   yyParser *pParser = (yyParser*)p;
   while( pParser->yytos>pParser->yystack ) yy_pop_parser_stack(pParser);
 #if YYSTACKDEPTH<=0
-  if( pParser->yystack!=&pParser->yystk0 ) free(pParser->yystack);
+  if( pParser->yystack!=pParser->yystkBase ){
+    free(pParser->yystack);
+#ifdef YYSTACKSPLIT
+    free(pParser->yyvstack);
 #endif
+  }
+#endif
+}
+
+/*
+** Get a parser ready for a new parse.  Destructors are called for all
+** stack elements, as in ParseFinalize(), but the stack keeps the memory
+** it has grown into, so that a parser that is reset between parses
+** stops allocating once its stack is deep enough.  The peak depth that
+** ParseStackPeak() reports starts over with the new parse.
+*/
+void ParseReset(void *p){
+  yyParser *pParser = (yyParser*)p;
+  while( pParser->yytos>pParser->yystack ) yy_pop_parser_stack(pParser);
+#ifdef YYTRACKMAXSTACKDEPTH
+  pParser->yyhwm = 0;
+#endif
+#ifndef YYNOERRORRECOVERY
+  pParser->yyerrcnt = -1;
+#endif
+  pParser->yystack[0].stateno = 0;
+  pParser->yystack[0].major = 0;
+}
+
+/* A copy of the stack of a parser, made by ParseSnapshot().  The entries
+** are yystack[0] through yytos.  With YYSTACKSPLIT, aValue[] holds their
+** semantic values. */
+typedef struct yySnapshot yySnapshot;
+struct yySnapshot {
+  int nEntry;                   /* Number of entries in aEntry[] */
+#ifndef YYNOERRORRECOVERY
+  int yyerrcnt;                 /* yyerrcnt of the parser */
+#endif
+  void (*xCopy)(void*,int,void*);  /* Copies a semantic value, or NULL */
+  void *pCopyArg;               /* First argument to xCopy */
+  yyStackEntry *aEntry;         /* The stack entries */
+#ifdef YYSTACKSPLIT
+  YYMINORTYPE *aValue;          /* Semantic values of aEntry[] */
+#endif
+};
+
+/* The header of a snapshot, sized so that the array after it is aligned
+** for semantic values and for stack entries alike */
+typedef union yySnapshotHead yySnapshotHead;
+union yySnapshotHead {
+  yySnapshot s;
+  YYMINORTYPE alignValue;
+  yyStackEntry alignEntry;
+};
+
+#ifdef YYSTACKSPLIT
+# define yySnapshotValue(S,I)  (&(S)->aValue[I])
+#else
+# define yySnapshotValue(S,I)  (&(S)->aEntry[I].minor)
+#endif
+
+/*
+** Save the state of a parser, so that ParseRestore() can later return
+** it to this point, for example at a statement boundary before an edit.
+** The snapshot is allocated with mallocProc and freed by
+** ParseSnapshotFree().  Return NULL if it cannot be allocated.
+**
+** The semantic values on the stack are copied bit for bit, and then
+** xCopy(pArg, major, pValue) is invoked on each copy, both here and in
+** ParseRestore().  If any values own resources that their %destructor
+** releases, xCopy must make pValue an independent copy (or take a
+** reference), because the snapshot and the parser each destroy theirs.
+** If xCopy is NULL, the %destructors are not run on the snapshot.
+*/
+void *ParseSnapshot(
+  void *p,                               /* The parser */
+  void *(*mallocProc)(YYMALLOCARGTYPE),  /* Allocates the snapshot */
+  void (*xCopy)(void*,int,void*),        /* Copies a semantic value */
+  void *pArg                             /* First argument to xCopy */
+){
+  yyParser *pParser = (yyParser*)p;
+  yySnapshot *pSnap;
+  int i, nEntry;
+  size_t nByte;
+
+  nEntry = (int)(pParser->yytos - pParser->yystack) + 1;
+  nByte = sizeof(yySnapshotHead) + nEntry*YYSTACKENTRYSIZE;
+  pSnap = (yySnapshot*)(*mallocProc)( (YYMALLOCARGTYPE)nByte );
+  if( pSnap==0 ) return 0;
+  pSnap->nEntry = nEntry;
+#ifndef YYNOERRORRECOVERY
+  pSnap->yyerrcnt = pParser->yyerrcnt;
+#endif
+  pSnap->xCopy = xCopy;
+  pSnap->pCopyArg = pArg;
+#ifdef YYSTACKSPLIT
+  pSnap->aValue = (YYMINORTYPE*)((yySnapshotHead*)pSnap + 1);
+  pSnap->aEntry = (yyStackEntry*)(pSnap->aValue + nEntry);
+#else
+  pSnap->aEntry = (yyStackEntry*)((yySnapshotHead*)pSnap + 1);
+#endif
+  for(i=0; i<nEntry; i++){
+    pSnap->aEntry[i] = pParser->yystack[i];
+    if( i==0 ) continue;
+#ifdef YYSTACKSPLIT
+    pSnap->aValue[i] = pParser->yyvstack[i];
+#endif
+    if( xCopy ) xCopy(pArg, pSnap->aEntry[i].major, yySnapshotValue(pSnap, i));
+  }
+  return (void*)pSnap;
+}
+
+/*
+** Return parser p to the state saved in pSnap by ParseSnapshot() on a
+** parser for the same grammar.  The current stack of p is popped, with
+** its destructors, first.  The snapshot is unchanged and can be restored
+** again.  Return 0 on success, or 1 if the stack of p cannot grow large
+** enough, in which case p is left reset, as by ParseReset().
+*/
+int ParseRestore(void *p, const void *pSnapshot){
+  yyParser *pParser = (yyParser*)p;
+  const yySnapshot *pSnap = (const yySnapshot*)pSnapshot;
+  int i;
+
+  ParseReset(p);
+#if YYSTACKDEPTH<=0
+  while( pParser->yystksz<pSnap->nEntry ){
+    if( yyGrowStack(pParser) ) return 1;
+  }
+#else
+  if( pSnap->nEntry>YYSTACKDEPTH ) return 1;
+#endif
+  for(i=1; i<pSnap->nEntry; i++){
+    pParser->yystack[i] = pSnap->aEntry[i];
+    *yyStackValue(pParser, &pParser->yystack[i]) = *yySnapshotValue(pSnap, i);
+    if( pSnap->xCopy ){
+      pSnap->xCopy(pSnap->pCopyArg, pSnap->aEntry[i].major,
+                   yyStackValue(pParser, &pParser->yystack[i]));
+    }
+  }
+  pParser->yytos = &pParser->yystack[pSnap->nEntry-1];
+#ifdef YYTRACKMAXSTACKDEPTH
+  if( pSnap->nEntry-1>pParser->yyhwm ) pParser->yyhwm = pSnap->nEntry-1;
+#endif
+#ifndef YYNOERRORRECOVERY
+  pParser->yyerrcnt = pSnap->yyerrcnt;
+#endif
+  return 0;
+}
+
+/*
+** Free a snapshot made by ParseSnapshot() on parser p, using freeProc.
+** If the snapshot was made with an xCopy function, the %destructors are
+** run on its semantic values.
+*/
+void ParseSnapshotFree(
+  void *p,                    /* The parser the snapshot was made on */
+  void *pSnapshot,            /* The snapshot */
+  void (*freeProc)(void*)     /* Function used to reclaim memory */
+){
+  yySnapshot *pSnap = (yySnapshot*)pSnapshot;
+  int i;
+  if( pSnap==0 ) return;
+  if( pSnap->xCopy ){
+    for(i=pSnap->nEntry-1; i>0; i--){
+      yy_destructor((yyParser*)p, pSnap->aEntry[i].major,
+                    yySnapshotValue(pSnap, i));
+    }
+  }
+  (*freeProc)(pSnap);
 }
 
 #ifndef Parse_ENGINEALWAYSONSTACK
@@ -472,6 +895,15 @@ int ParseStackPeak(void *p){
 static unsigned char yycoverage[YYNSTATE][YYNTOKEN];
 #endif
 
+/* These arrays count how often each state was looked up with each
+** lookahead, terminal or not, and how often each rule was reduced.
+** ParseProfile() writes them out for the -G option of lemon.
+*/
+#if defined(YYPROFILE)
+static unsigned long yyprofLookup[YYNSTATE][YYNOCODE];
+static unsigned long yyprofRule[YYNRULE];
+#endif
+
 /*
 ** Write into out a description of every state/lookahead combination that
 **
@@ -500,6 +932,356 @@ int ParseCoverage(FILE *out){
 }
 #endif
 
+/*
+** Write the counts gathered with YYPROFILE to out, in the format that
+** the -G option of lemon reads.  Only non-zero counts are written.
+*/
+#if defined(YYPROFILE)
+void ParseProfile(FILE *out){
+  int stateno, iLookAhead, i;
+  fprintf(out, "profile %d %d %d\n", YYNSTATE, YYNOCODE, YYNRULE);
+  for(stateno=0; stateno<YYNSTATE; stateno++){
+    for(iLookAhead=0; iLookAhead<YYNOCODE; iLookAhead++){
+      if( yyprofLookup[stateno][iLookAhead]==0 ) continue;
+      fprintf(out, "lookup %d %d %lu\n", stateno, iLookAhead,
+              yyprofLookup[stateno][iLookAhead]);
+    }
+  }
+  for(i=0; i<YYNRULE; i++){
+    if( yyprofRule[i] ) fprintf(out, "rule %d %lu\n", i, yyprofRule[i]);
+  }
+}
+#endif
+
+#ifdef YYSTATS
+/*
+** The counts of a parser, as ParseGetStats() reports them.  The layout
+** does not depend on the grammar, so a caller declares the struct as it
+** is here, with the %name of the grammar in place of "Parse".
+*/
+typedef struct ParseStatsT ParseStatsT;
+struct ParseStatsT {
+  unsigned long nShift;          /* Tokens shifted, the error token too */
+  unsigned long nShiftReduce;    /* Shifts that were SHIFTREDUCE actions */
+  unsigned long nDefaultReduce;  /* Lookaheads missed, default was a reduce */
+  unsigned long nFallback;       /* Lookaheads that took their fallback */
+  unsigned long nSyntaxError;    /* Syntax errors, reported or not */
+  unsigned long nRecovery;       /* Shifts of the error token */
+  int nRule;                     /* Number of rules, YYNRULE */
+  const unsigned long *aRule;    /* Reductions by each rule */
+  int nDepth;                    /* Depth buckets, YYSTATSDEPTH */
+  const unsigned long *aDepth;   /* Shifts at each stack depth */
+};
+
+/*
+** Fill *pOut with the counts of parser p.  aRule[] and aDepth[] point
+** into the parser, so they follow its counts until it is freed, and are
+** zeroed along with the rest by ParseStats() with bReset.
+*/
+void ParseGetStats(void *p, ParseStatsT *pOut){
+  yyParser *pParser = (yyParser*)p;
+  yyStats *pStats = &pParser->yystats;
+  pOut->nShift = pStats->nShift;
+  pOut->nShiftReduce = pStats->nShiftReduce;
+  pOut->nDefaultReduce = pStats->nDefaultReduce;
+  pOut->nFallback = pStats->nFallback;
+  pOut->nSyntaxError = pStats->nSyntaxError;
+  pOut->nRecovery = pStats->nRecovery;
+  pOut->nRule = YYNRULE;
+  pOut->aRule = pStats->aRule;
+  pOut->nDepth = YYSTATSDEPTH;
+  pOut->aDepth = pStats->aDepth;
+}
+
+/*
+** Write the counts of parser p to out, if out is not NULL, and then
+** reset them if bReset is true.  Each line is a name and its count, or
+** "rule R COUNT" (followed by the rule in builds without NDEBUG) for
+** each rule reduced and "depth D COUNT" for each stack depth reached.
+*/
+void ParseStats(void *p, FILE *out, int bReset){
+  yyParser *pParser = (yyParser*)p;
+  yyStats *pStats = &pParser->yystats;
+  int i;
+  if( out ){
+    fprintf(out, "shift %lu\n", pStats->nShift);
+    fprintf(out, "shiftreduce %lu\n", pStats->nShiftReduce);
+    fprintf(out, "default-reduce %lu\n", pStats->nDefaultReduce);
+    fprintf(out, "fallback %lu\n", pStats->nFallback);
+    fprintf(out, "syntax-error %lu\n", pStats->nSyntaxError);
+    fprintf(out, "recovery %lu\n", pStats->nRecovery);
+    for(i=0; i<YYNRULE; i++){
+      if( pStats->aRule[i]==0 ) continue;
+#ifndef NDEBUG
+      fprintf(out, "rule %d %lu %s\n", i, pStats->aRule[i], yyRuleName[i]);
+#else
+      fprintf(out, "rule %d %lu\n", i, pStats->aRule[i]);
+#endif
+    }
+    for(i=0; i<YYSTATSDEPTH; i++){
+      if( pStats->aDepth[i]==0 ) continue;
+      fprintf(out, "depth %d %lu\n", i, pStats->aDepth[i]);
+    }
+  }
+  if( bReset ) memset(pStats, 0, sizeof(*pStats));
+}
+#endif
+
+#ifdef YYTRACERING
+#include <stdio.h>
+
+/* Write the 4-byte big-endian integers of a saved ring */
+static void yyRingPut32(FILE *out, unsigned int v){
+  putc((v>>24)&0xff, out);
+  putc((v>>16)&0xff, out);
+  putc((v>>8)&0xff, out);
+  putc(v&0xff, out);
+}
+
+/*
+** Write the events in the ring of parser p to out, oldest first.  The
+** format is the 4 bytes "LMRG", then YYNSTATE, YYNRULE, YYNOCODE and the
+** number of events, then each event as its type, symbol, state and
+** argument, all as 4-byte big-endian integers.  Return the number of
+** events written.
+*/
+int ParseTraceRingSave(void *p, FILE *out){
+  yyParser *pParser = (yyParser*)p;
+  unsigned int i, n, iFirst;
+  yyTraceEvent *pEv;
+  n = pParser->yyringpos<YYTRACERING ? pParser->yyringpos : YYTRACERING;
+  iFirst = pParser->yyringpos - n;
+  fwrite("LMRG", 1, 4, out);
+  yyRingPut32(out, YYNSTATE);
+  yyRingPut32(out, YYNRULE);
+  yyRingPut32(out, YYNOCODE);
+  yyRingPut32(out, n);
+  for(i=0; i<n; i++){
+    pEv = &pParser->yyring[(iFirst+i) & (YYTRACERING-1)];
+    yyRingPut32(out, pEv->eType);
+    yyRingPut32(out, pEv->iSymbol);
+    yyRingPut32(out, pEv->iState);
+    yyRingPut32(out, pEv->iArg);
+  }
+  return (int)n;
+}
+
+#ifndef NDEBUG
+/* Read one 4-byte big-endian integer of a saved ring.  Return 0 at EOF. */
+static int yyRingGet32(FILE *in, unsigned int *pV){
+  unsigned int v = 0;
+  int i, c;
+  for(i=0; i<4; i++){
+    if( (c = getc(in))==EOF ) return 0;
+    v = (v<<8) | (unsigned int)c;
+  }
+  *pV = v;
+  return 1;
+}
+
+/*
+** Render a ring written by ParseTraceRingSave() as text on out, in the
+** words of ParseTrace().  The ring may come from any build of the same
+** grammar, including one with NDEBUG.  Return the number of events, or
+** -1 if in does not hold a ring of a parser for this grammar.
+*/
+int ParseTraceRingDecode(FILE *in, FILE *out){
+  char zMagic[4];
+  unsigned int a[4], i, n;
+  if( fread(zMagic, 1, 4, in)!=4 || zMagic[0]!='L' || zMagic[1]!='M'
+   || zMagic[2]!='R' || zMagic[3]!='G' ){
+    return -1;
+  }
+  for(i=0; i<4; i++){
+    if( !yyRingGet32(in, &a[i]) ) return -1;
+  }
+  if( a[0]!=YYNSTATE || a[1]!=YYNRULE || a[2]!=YYNOCODE ) return -1;
+  for(n=0; n<a[3]; n++){
+    unsigned int eType, iSymbol, iState, iArg;
+    if( !yyRingGet32(in, &eType) || !yyRingGet32(in, &iSymbol)
+     || !yyRingGet32(in, &iState) || !yyRingGet32(in, &iArg)
+     || iSymbol>=YYNOCODE
+    ){
+      return -1;
+    }
+    switch( eType ){
+      case YYEV_SHIFT:
+      case YYEV_REDUCE:
+        if( eType==YYEV_REDUCE ){
+          if( iArg>=YYNRULE ) return -1;
+          fprintf(out, "Reduce %u [%s], shift '%s'",
+                  iArg, yyRuleName[iArg], yyTokenName[iSymbol]);
+        }else{
+          fprintf(out, "Shift '%s'", yyTokenName[iSymbol]);
+        }
+        if( iState<YYNSTATE ){
+          fprintf(out, ", go to state %u\n", iState);
+        }else if( iState>=YY_MIN_REDUCE ){
+          fprintf(out, ", pending reduce %u\n", iState-YY_MIN_REDUCE);
+        }else{
+          fprintf(out, "\n");
+        }
+        break;
+#ifdef YYFALLBACK
+      case YYEV_FALLBACK:
+        if( iSymbol>=sizeof(yyFallback)/sizeof(yyFallback[0]) ) return -1;
+        fprintf(out, "FALLBACK %s => %s in state %u\n",
+                yyTokenName[iSymbol], yyTokenName[yyFallback[iSymbol]], iState);
+        break;
+#endif
+      case YYEV_WILDCARD:
+        fprintf(out, "WILDCARD %s in state %u\n", yyTokenName[iSymbol], iState);
+        break;
+      case YYEV_ERROR:
+        fprintf(out, "Syntax Error on '%s' in state %u\n",
+                yyTokenName[iSymbol], iState);
+        break;
+      case YYEV_ACCEPT:
+        fprintf(out, "Accept!\n");
+        break;
+      default:
+        return -1;
+    }
+  }
+  return (int)n;
+}
+#endif /* NDEBUG */
+#endif /* YYTRACERING */
+
+#if defined(YYRESOLVEDFALLBACK) && (defined(YYSTATS) || defined(YYTRACERING))
+/*
+** With -F, the fallback and wildcard actions are in the tables, so the
+** lookup of iLookAhead in stateno finds them like any other.  Count and
+** record the fallback and wildcard that the lookup stands for, as the
+** search in yy_find_shift_action() would have without -F.
+*/
+static void yy_resolved_events(
+  yyParser *yypParser,      /* The parser */
+  YYCODETYPE iLookAhead,    /* The look-ahead token */
+  YYACTIONTYPE stateno      /* Current state number */
+){
+  unsigned int k = (unsigned int)stateno*YYNTOKEN + iLookAhead;
+  int mark;
+
+  (void)yypParser;          /* Unused for a wildcard without YYTRACERING */
+  assert( k/4<sizeof(yy_resolved)/sizeof(yy_resolved[0]) );
+  mark = (yy_resolved[k/4] >> (2*(k%4))) & 3;
+  if( mark==0 ) return;
+#ifdef YYFALLBACK
+  if( mark & 1 ){
+    yyRecordEvent(yypParser, YYEV_FALLBACK, iLookAhead, stateno, 0);
+    yyStatsIncr(yypParser, nFallback);
+    iLookAhead = yyFallback[iLookAhead];
+  }
+#endif
+  if( mark & 2 ){
+    yyRecordEvent(yypParser, YYEV_WILDCARD, iLookAhead, stateno, 0);
+  }
+}
+#endif
+
+#ifdef YYCODEDACTIONS
+/*
+** Find the appropriate action for a parser given the terminal
+** look-ahead token iLookAhead, using the switch statements of the
+** -k option.
+*/
+static YYACTIONTYPE yy_find_shift_action(
+  YYCODETYPE iLookAhead,    /* The look-ahead token */
+  YYACTIONTYPE stateno      /* Current state number */
+  YYFINDPDECL               /* The parser, for YYTRACERING or YYSTATS */
+){
+  YYACTIONTYPE yyact;
+
+#ifdef YYTRACERING
+  (void)yypParser;          /* Unused without fallbacks or a wildcard */
+#endif
+  if( stateno>YY_MAX_SHIFT ) return stateno;
+  assert( stateno < YYNSTATE );
+#if defined(YYCOVERAGE)
+  yycoverage[stateno][iLookAhead] = 1;
+#endif
+#if defined(YYPROFILE)
+  yyprofLookup[stateno][iLookAhead]++;
+#endif
+#if defined(YYRESOLVEDFALLBACK) && (defined(YYSTATS) || defined(YYTRACERING))
+  yy_resolved_events(yypParser, iLookAhead, stateno);
+#endif
+  do{
+    assert( iLookAhead!=YYNOCODE );
+    assert( iLookAhead < YYNTOKEN );
+    yyact = yy_coded_shift_action(stateno, iLookAhead);
+    if( yyact==YY_NO_ACTION ){
+#if defined(YYFALLBACK) && !defined(YYRESOLVEDFALLBACK)
+      YYCODETYPE iFallback;            /* Fallback token */
+      assert( iLookAhead<sizeof(yyFallback)/sizeof(yyFallback[0]) );
+      iFallback = yyFallback[iLookAhead];
+      if( iFallback!=0 ){
+#ifndef NDEBUG
+        if( yyTraceFILE ){
+          fprintf(yyTraceFILE, "%sFALLBACK %s => %s\n",
+             yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[iFallback]);
+        }
+#endif
+        assert( yyFallback[iFallback]==0 ); /* Fallback loop must terminate */
+        yyRecordEvent(yypParser, YYEV_FALLBACK, iLookAhead, stateno, 0);
+        yyStatsIncr(yypParser, nFallback);
+        iLookAhead = iFallback;
+        continue;
+      }
+#endif
+#if defined(YYWILDCARD) && !defined(YYRESOLVEDFALLBACK)
+      if( iLookAhead>0 ){
+        yyact = yy_coded_shift_action(stateno, YYWILDCARD);
+        if( yyact!=YY_NO_ACTION ){
+#ifndef NDEBUG
+          if( yyTraceFILE ){
+            fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
+               yyTracePrompt, yyTokenName[iLookAhead],
+               yyTokenName[YYWILDCARD]);
+          }
+#endif /* NDEBUG */
+          yyRecordEvent(yypParser, YYEV_WILDCARD, iLookAhead, stateno, 0);
+          return yyact;
+        }
+      }
+#endif /* YYWILDCARD */
+#ifdef YYSTATS
+      if( yy_default[stateno]>=YY_MIN_REDUCE ){
+        yyStatsIncr(yypParser, nDefaultReduce);
+      }
+#endif
+      return yy_default[stateno];
+    }
+    return yyact;
+  }while(1);
+}
+
+/*
+** Find the appropriate action for a parser given the non-terminal
+** look-ahead token iLookAhead, using the switch statements of the
+** -k option.
+*/
+static YYACTIONTYPE yy_find_reduce_action(
+  YYACTIONTYPE stateno,     /* Current state number */
+  YYCODETYPE iLookAhead     /* The look-ahead token */
+){
+  YYACTIONTYPE yyact;
+  assert( iLookAhead!=YYNOCODE );
+#if defined(YYPROFILE)
+  if( stateno<YYNSTATE ) yyprofLookup[stateno][iLookAhead]++;
+#endif
+  yyact = yy_coded_reduce_action(stateno, iLookAhead);
+#ifdef YYERRORSYMBOL
+  if( yyact==YY_NO_ACTION ){
+    return yy_default[stateno];
+  }
+#else
+  assert( yyact!=YY_NO_ACTION );
+#endif
+  return yyact;
+}
+#else /* YYCODEDACTIONS */
 /*
 ** Find the appropriate action for a parser given the terminal
 ** look-ahead token iLookAhead.
@@ -507,13 +1289,23 @@ int ParseCoverage(FILE *out){
 static YYACTIONTYPE yy_find_shift_action(
   YYCODETYPE iLookAhead,    /* The look-ahead token */
   YYACTIONTYPE stateno      /* Current state number */
+  YYFINDPDECL               /* The parser, for YYTRACERING or YYSTATS */
 ){
   int i;
 
+#ifdef YYTRACERING
+  (void)yypParser;          /* Unused without fallbacks or a wildcard */
+#endif
   if( stateno>YY_MAX_SHIFT ) return stateno;
   assert( stateno <= YY_SHIFT_COUNT );
 #if defined(YYCOVERAGE)
   yycoverage[stateno][iLookAhead] = 1;
+#endif
+#if defined(YYPROFILE)
+  yyprofLookup[stateno][iLookAhead]++;
+#endif
+#if defined(YYRESOLVEDFALLBACK) && (defined(YYSTATS) || defined(YYTRACERING))
+  yy_resolved_events(yypParser, iLookAhead, stateno);
 #endif
   do{
     i = yy_shift_ofst[stateno];
@@ -525,7 +1317,7 @@ static YYACTIONTYPE yy_find_shift_action(
     i += iLookAhead;
     assert( i<(int)YY_NLOOKAHEAD );
     if( yy_lookahead[i]!=iLookAhead ){
-#ifdef YYFALLBACK
+#if defined(YYFALLBACK) && !defined(YYRESOLVEDFALLBACK)
       YYCODETYPE iFallback;            /* Fallback token */
       assert( iLookAhead<sizeof(yyFallback)/sizeof(yyFallback[0]) );
       iFallback = yyFallback[iLookAhead];
@@ -537,11 +1329,13 @@ static YYACTIONTYPE yy_find_shift_action(
         }
 #endif
         assert( yyFallback[iFallback]==0 ); /* Fallback loop must terminate */
+        yyRecordEvent(yypParser, YYEV_FALLBACK, iLookAhead, stateno, 0);
+        yyStatsIncr(yypParser, nFallback);
         iLookAhead = iFallback;
         continue;
       }
 #endif
-#ifdef YYWILDCARD
+#if defined(YYWILDCARD) && !defined(YYRESOLVEDFALLBACK)
       {
         int j = i - iLookAhead + YYWILDCARD;
         assert( j<(int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])) );
@@ -553,10 +1347,16 @@ static YYACTIONTYPE yy_find_shift_action(
                yyTokenName[YYWILDCARD]);
           }
 #endif /* NDEBUG */
+          yyRecordEvent(yypParser, YYEV_WILDCARD, iLookAhead, stateno, 0);
           return yy_action[j];
         }
       }
 #endif /* YYWILDCARD */
+#ifdef YYSTATS
+      if( yy_default[stateno]>=YY_MIN_REDUCE ){
+        yyStatsIncr(yypParser, nDefaultReduce);
+      }
+#endif
       return yy_default[stateno];
     }else{
       assert( i>=0 && i<(int)(sizeof(yy_action)/sizeof(yy_action[0])) );
@@ -574,6 +1374,9 @@ static YYACTIONTYPE yy_find_reduce_action(
   YYCODETYPE iLookAhead     /* The look-ahead token */
 ){
   int i;
+#if defined(YYPROFILE)
+  if( stateno<YYNSTATE ) yyprofLookup[stateno][iLookAhead]++;
+#endif
 #ifdef YYERRORSYMBOL
   if( stateno>YY_REDUCE_COUNT ){
     return yy_default[stateno];
@@ -594,6 +1397,7 @@ static YYACTIONTYPE yy_find_reduce_action(
 #endif
   return yy_action[i];
 }
+#endif /* YYCODEDACTIONS */
 
 /*
 ** The following routine is called if the stack overflows.
@@ -671,11 +1475,21 @@ static void yy_shift(
 #endif
   if( yyNewState > YY_MAX_SHIFT ){
     yyNewState += YY_MIN_REDUCE - YY_MIN_SHIFTREDUCE;
+    yyStatsIncr(yypParser, nShiftReduce);
+  }
+#ifdef YYSTATS
+  {
+    int yydepth = (int)(yypParser->yytos - yypParser->yystack);
+    if( yydepth>=YYSTATSDEPTH ) yydepth = YYSTATSDEPTH-1;
+    yypParser->yystats.aDepth[yydepth]++;
+    yypParser->yystats.nShift++;
   }
+#endif
   yytos = yypParser->yytos;
   yytos->stateno = yyNewState;
   yytos->major = yyMajor;
-  yytos->minor.yy0 = yyMinor;
+  yyStackValue(yypParser, yytos)->yy0 = yyMinor;
+  yyRecordEvent(yypParser, YYEV_SHIFT, yyMajor, yyNewState, 0);
   yyTraceShift(yypParser, yyNewState, "Shift");
 }
 
@@ -713,11 +1527,24 @@ static YYACTIONTYPE yy_reduce(
   int yygoto;                     /* The next state */
   YYACTIONTYPE yyact;             /* The next action */
   yyStackEntry *yymsp;            /* The top of the parser's stack */
+#ifdef YYSTACKSPLIT
+  YYMINORTYPE *yyvsp;             /* Semantic value of yymsp */
+#endif
   int yysize;                     /* Amount to pop the stack */
   ParseARG_FETCH
   (void)yyLookahead;
   (void)yyLookaheadToken;
   yymsp = yypParser->yytos;
+#ifdef YYSTACKSPLIT
+  yyvsp = yyStackValue(yypParser, yymsp);
+  (void)yyvsp;
+#endif
+#if defined(YYPROFILE)
+  yyprofRule[yyruleno]++;
+#endif
+#ifdef YYSTATS
+  yypParser->yystats.aRule[yyruleno]++;
+#endif
 
   switch( yyruleno ){
   /* Beginning here are the reduction cases.  A typical example
@@ -748,6 +1575,7 @@ static YYACTIONTYPE yy_reduce(
   yypParser->yytos = yymsp;
   yymsp->stateno = (YYACTIONTYPE)yyact;
   yymsp->major = (YYCODETYPE)yygoto;
+  yyRecordEvent(yypParser, YYEV_REDUCE, yygoto, yyact, yyruleno);
   yyTraceShift(yypParser, yyact, "... then shift");
   return yyact;
 }
@@ -808,6 +1636,7 @@ static void yy_accept(
     fprintf(yyTraceFILE,"%sAccept!\n",yyTracePrompt);
   }
 #endif
+  yyRecordEvent(yypParser, YYEV_ACCEPT, 0, 0, 0);
 #ifndef YYNOERRORRECOVERY
   yypParser->yyerrcnt = -1;
 #endif
@@ -821,44 +1650,30 @@ static void yy_accept(
   ParseCTX_STORE
 }
 
-/* The main parser program.
-** The first argument is a pointer to a structure obtained from
-** "ParseAlloc" which describes the current state of the parser.
-** The second argument is the major token number.  The third is
-** the minor token.  The fourth optional argument is whatever the
-** user wants (and specified in the grammar) and is available for
-** use by the action routines.
-**
-** Inputs:
-** <ul>
-** <li> A pointer to the parser (an opaque structure.)
-** <li> The major token number.
-** <li> The minor token number.
-** <li> An option argument of a grammar-specified type.
-** </ul>
+/* Process one token.  This is the body of Parse() and ParseBatch().
+** It is only called from ParseBatch(), so optimizing compilers will
+** in-line it there and keep the parser pointer and %extra_context in
+** registers across a whole array of tokens.
 **
-** Outputs:
-** None.
+** The return value is non-zero if the parser accepted or reported an
+** error (%syntax_error, %parse_failure or %stack_overflow) on this token.
 */
-void Parse(
-  void *yyp,                   /* The parser */
+static int yy_parse_token(
+  yyParser *yypParser,         /* The parser */
   int yymajor,                 /* The major token code number */
   ParseTOKENTYPE yyminor       /* The value for the token */
-  ParseARG_PDECL               /* Optional %extra_argument parameter */
+  ParseCTX_PDECL               /* %extra_context */
 ){
   YYMINORTYPE yyminorunion;
   YYACTIONTYPE yyact;   /* The parser action. */
+  int yystop = 0;       /* True to end a ParseBatch() after this token */
 #if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
   int yyendofinput;     /* True if we are at the end of input */
 #endif
 #ifdef YYERRORSYMBOL
   int yyerrorhit = 0;   /* True if yymajor has invoked an error */
 #endif
-  yyParser *yypParser = (yyParser*)yyp;  /* The parser */
-  ParseCTX_FETCH
-  ParseARG_STORE
 
-  assert( yypParser->yytos!=0 );
 #if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
   yyendofinput = (yymajor==0);
 #endif
@@ -879,7 +1694,7 @@ void Parse(
   while(1){ /* Exit by "break" */
     assert( yypParser->yytos>=yypParser->yystack );
     assert( yyact==yypParser->yytos->stateno );
-    yyact = yy_find_shift_action((YYCODETYPE)yymajor,yyact);
+    yyact = yy_find_shift_action((YYCODETYPE)yymajor,yyact YYFINDPARAM);
     if( yyact >= YY_MIN_REDUCE ){
       unsigned int yyruleno = yyact - YY_MIN_REDUCE; /* Reduce by this rule */
 #ifndef NDEBUG
@@ -914,12 +1729,14 @@ void Parse(
 #if YYSTACKDEPTH>0 
         if( yypParser->yytos>=yypParser->yystackEnd ){
           yyStackOverflow(yypParser);
+          yystop = 1;
           break;
         }
 #else
         if( yypParser->yytos>=&yypParser->yystack[yypParser->yystksz-1] ){
           if( yyGrowStack(yypParser) ){
             yyStackOverflow(yypParser);
+            yystop = 1;
             break;
           }
         }
@@ -935,10 +1752,13 @@ void Parse(
     }else if( yyact==YY_ACCEPT_ACTION ){
       yypParser->yytos--;
       yy_accept(yypParser);
-      return;
+      return 1;
     }else{
       assert( yyact == YY_ERROR_ACTION );
       yyminorunion.yy0 = yyminor;
+      yyRecordEvent(yypParser, YYEV_ERROR, yymajor,
+                    yypParser->yytos->stateno, 0);
+      yyStatsIncr(yypParser, nSyntaxError);
 #ifdef YYERRORSYMBOL
       int yymx;
 #endif
@@ -969,6 +1789,7 @@ void Parse(
       */
       if( yypParser->yyerrcnt<0 ){
         yy_syntax_error(yypParser,yymajor,yyminor);
+        yystop = 1;
       }
       yymx = yypParser->yytos->major;
       if( yymx==YYERRORSYMBOL || yyerrorhit ){
@@ -993,9 +1814,11 @@ void Parse(
 #ifndef YYNOERRORRECOVERY
           yypParser->yyerrcnt = -1;
 #endif
+          yystop = 1;
           yymajor = YYNOCODE;
         }else if( yymx!=YYERRORSYMBOL ){
           yy_shift(yypParser,yyact,YYERRORSYMBOL,yyminor);
+          yyStatsIncr(yypParser, nRecovery);
         }
       }
       yypParser->yyerrcnt = 3;
@@ -1012,6 +1835,7 @@ void Parse(
       */
       yy_syntax_error(yypParser,yymajor, yyminor);
       yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
+      yystop = 1;
       break;
 #else  /* YYERRORSYMBOL is not defined */
       /* This is what we do if the grammar does not define ERROR:
@@ -1025,6 +1849,7 @@ void Parse(
       */
       if( yypParser->yyerrcnt<=0 ){
         yy_syntax_error(yypParser,yymajor, yyminor);
+        yystop = 1;
       }
       yypParser->yyerrcnt = 3;
       yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
@@ -1033,6 +1858,7 @@ void Parse(
 #ifndef YYNOERRORRECOVERY
         yypParser->yyerrcnt = -1;
 #endif
+        yystop = 1;
       }
       break;
 #endif
@@ -1050,7 +1876,67 @@ void Parse(
     fprintf(yyTraceFILE,"]\n");
   }
 #endif
-  return;
+  return yystop;
+}
+
+/* Parse an array of tokens.  The first argument is a pointer to a
+** structure obtained from "ParseAlloc".  Tokens majors[0..n-1], with
+** semantic values minors[0..n-1], are handed to the parser in order,
+** with exactly the same effect as calling Parse() once for each of them.
+** The fifth optional argument is as for Parse().
+**
+** The batch ends early after a token on which the parser accepts, or
+** on which it invokes %syntax_error, %parse_failure or %stack_overflow.
+** The return value is the number of tokens consumed, so that a caller
+** can tell where the batch ended and continue from there.
+*/
+size_t ParseBatch(
+  void *yyp,                   /* The parser */
+  const int *majors,           /* The major token code numbers */
+  ParseTOKENTYPE const *minors,/* The values for the tokens */
+  size_t n                     /* Number of tokens in majors[] and minors[] */
+  ParseARG_PDECL               /* Optional %extra_argument parameter */
+){
+  yyParser *yypParser = (yyParser*)yyp;  /* The parser */
+  size_t i;
+  ParseCTX_FETCH
+  ParseARG_STORE
+
+  assert( yypParser->yytos!=0 );
+  for(i=0; i<n; i++){
+    if( yy_parse_token(yypParser, majors[i], minors[i] ParseCTX_PARAM) ){
+      return i+1;
+    }
+  }
+  return n;
+}
+
+/* The main parser program.
+** The first argument is a pointer to a structure obtained from
+** "ParseAlloc" which describes the current state of the parser.
+** The second argument is the major token number.  The third is
+** the minor token.  The fourth optional argument is whatever the
+** user wants (and specified in the grammar) and is available for
+** use by the action routines.
+**
+** Inputs:
+** <ul>
+** <li> A pointer to the parser (an opaque structure.)
+** <li> The major token number.
+** <li> The minor token number.
+** <li> An option argument of a grammar-specified type.
+** </ul>
+**
+** Outputs:
+** None.
+*/
+void Parse(
+  void *yyp,                   /* The parser */
+  int yymajor,                 /* The major token code number */
+  ParseTOKENTYPE yyminor       /* The value for the token */
+  ParseARG_PDECL               /* Optional %extra_argument parameter */
+){
+  ParseBatch(yyp, &yymajor, &yyminor, 1 ParseARG_PARAM);
 }
 
 /*
@@ -1 +1 @@
-gcc -g -o lemon lemon.c
+gcc -g -o lemon lemon.c -pthread
@@ -0,0 +1,12 @@
+/*
+** A grammar whose semantic values need 16-byte alignment on most 64-bit
+** targets, for aligned_test.c.
+*/
+%name Aligned
+%token_type {long double}
+%extra_argument {long double *pResult}
+%type sum {long double}
+
+prog ::= sum(S). { *pResult = S; }
+sum(A) ::= sum(B) PLUS NUM(C). { A = B + C; }
+sum(A) ::= NUM(B). { A = B; }
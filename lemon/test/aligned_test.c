@@ -0,0 +1,75 @@
+/*
+** Check that ParseSnapshot() keeps semantic values that need more than
+** 8-byte alignment aligned, with and without -V, and that restoring such a
+** snapshot gives the same result as parsing straight through.
+**
+**	aligned_test [terms]
+*/
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "aligned.h"
+
+void *AlignedAlloc(void *(*)(size_t));
+void Aligned(void*, int, long double, long double*);
+void AlignedFree(void*, void (*)(void*));
+void *AlignedSnapshot(void*, void *(*)(size_t),
+                      void (*)(void*,int,void*), void*);
+int AlignedRestore(void*, const void*);
+void AlignedSnapshotFree(void*, void*, void (*)(void*));
+
+struct alignProbe { char c; long double x; };
+#define VALUE_ALIGN offsetof(struct alignProbe, x)
+
+/* Count the snapshot values that are not aligned for a long double */
+static void checkValue(void *pArg, int major, void *pValue){
+  (void)major;
+  if( (size_t)(char*)pValue % VALUE_ALIGN ) ++*(int*)pArg;
+}
+
+/* Feed term i of the sum 0.5 + 1.5 + 2.5 + ... */
+static void feed(void *p, int i, long double *pResult){
+  if( i>0 ) Aligned(p, PLUS, 0, pResult);
+  Aligned(p, NUM, i + 0.5L, pResult);
+}
+
+int main(int argc, char **argv){
+  int nTerm = argc>1 ? atoi(argv[1]) : 100;
+  long double resFull = 0, resRestored = 0;
+  int nMisaligned = 0;
+  void *aSnap[3];
+  void *p;
+  int i;
+
+  if( nTerm<3 ) return 1;
+  p = AlignedAlloc(malloc);
+  for(i=0; i<nTerm; i++){
+    if( i==nTerm/2 ){
+      aSnap[0] = AlignedSnapshot(p, malloc, checkValue, &nMisaligned);
+    }
+    feed(p, i, &resFull);
+  }
+  aSnap[1] = AlignedSnapshot(p, malloc, checkValue, &nMisaligned);
+  Aligned(p, PLUS, 0, &resFull);
+  aSnap[2] = AlignedSnapshot(p, malloc, checkValue, &nMisaligned);
+  Aligned(p, NUM, 0, &resFull);
+  Aligned(p, 0, 0, &resFull);
+
+  if( aSnap[0]==0 || aSnap[1]==0 || aSnap[2]==0 ) return 1;
+  if( AlignedRestore(p, aSnap[0]) ) return 1;
+  for(i=nTerm/2; i<nTerm; i++) feed(p, i, &resRestored);
+  Aligned(p, 0, 0, &resRestored);
+
+  if( nMisaligned ){
+    printf("%d snapshot values are not aligned to %d bytes\n",
+           nMisaligned, (int)VALUE_ALIGN);
+    return 1;
+  }
+  if( resFull!=resRestored ){
+    printf("restored parse gives %Lg, not %Lg\n", resRestored, resFull);
+    return 1;
+  }
+  for(i=0; i<3; i++) AlignedSnapshotFree(p, aSnap[i], free);
+  AlignedFree(p, free);
+  return 0;
+}
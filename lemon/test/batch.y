@@ -0,0 +1,30 @@
+/*
+** Statements with error recovery, for batch_test.c.  Every reduction,
+** syntax error and accept is folded into a hash in the BatchLog, so two
+** runs that do different things give different hashes.
+*/
+%name Batch
+%include {
+#include <assert.h>
+struct BatchLog {
+  unsigned long h;    /* Hash of everything the parser did */
+  int nStop;          /* Syntax errors and accepts so far */
+};
+}
+%token_type {int}
+%extra_argument {struct BatchLog *pLog}
+%type e {int}
+%syntax_error { pLog->h = pLog->h*31 + 1000 + yymajor; pLog->nStop++; }
+%parse_accept { pLog->h = pLog->h*31 + 2000; pLog->nStop++; }
+%left PLUS.
+%left TIMES.
+
+prog ::= stmts.
+stmts ::= .
+stmts ::= stmts stmt SEMI.
+stmt ::= e(A). { pLog->h = pLog->h*31 + (unsigned)A; }
+stmt ::= error. { pLog->h = pLog->h*31 + 3000; }
+e(A) ::= e(B) PLUS e(C). { A = (B + C) % 1000; }
+e(A) ::= e(B) TIMES e(C). { A = B * C % 1000; }
+e(A) ::= LP e(B) RP. { A = B; }
+e(A) ::= NUM(B). { A = B; }
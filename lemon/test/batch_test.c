@@ -0,0 +1,121 @@
+/*
+** Feed the same tokens to a parser one at a time with Parse() and in
+** arrays with ParseBatch(), and check that both do the same thing.
+**
+**	batch_test [statements]
+**
+** The tokens are several programs, each ended by the end-of-input token,
+** with syntax errors in some statements.  ParseBatch() is called on the
+** whole array, and on runs of random length, and continued after each
+** early return.  It must return just after each token on which Parse()
+** reported an error or accepted, and nowhere else before the end.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "batch.h"
+
+/* As in batch.y */
+struct BatchLog {
+  unsigned long h;
+  int nStop;
+};
+
+void *BatchAlloc(void *(*)(size_t));
+void Batch(void*, int, int, struct BatchLog*);
+size_t BatchBatch(void*, const int*, const int*, size_t, struct BatchLog*);
+void BatchFree(void*, void (*)(void*));
+
+static unsigned long long seed = 1;
+static int rnd(int n){
+  seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+  return (int)((seed>>33) % (unsigned)n);
+}
+
+/* Write nProg programs of about nStmt statements each, every tenth
+** statement broken, into aMajor[]/aMinor[] and return the token count */
+static int makeTokens(int *aMajor, int *aMinor, int nProg, int nStmt){
+  int n = 0, p, i, j;
+  for(p=0; p<nProg; p++){
+    for(i=0; i<nStmt; i++){
+      aMajor[n] = NUM; aMinor[n++] = rnd(100);
+      for(j=rnd(4); j>0; j--){
+        aMajor[n] = rnd(2) ? PLUS : TIMES; aMinor[n++] = 0;
+        aMajor[n] = NUM; aMinor[n++] = rnd(100);
+      }
+      if( rnd(10)==0 ){
+        aMajor[n] = rnd(2) ? PLUS : RP; aMinor[n++] = 0;
+      }
+      aMajor[n] = SEMI; aMinor[n++] = 0;
+    }
+    aMajor[n] = 0; aMinor[n++] = 0;
+  }
+  return n;
+}
+
+/* Parse aMajor[0..n-1] with ParseBatch() in runs of at most nRun tokens,
+** or of random length if nRun is 0.  Return the number of mismatches
+** between where the batches ended and aStop[], which is true for the
+** tokens where Parse() stopped. */
+static int runBatches(
+  const int *aMajor, const int *aMinor, const char *aStop, int n,
+  int nRun, struct BatchLog *pLog
+){
+  void *p = BatchAlloc(malloc);
+  int nBad = 0, i = 0;
+  while( i<n ){
+    size_t nIn = nRun ? (size_t)nRun : (size_t)(1 + rnd(300));
+    size_t nDone;
+    int j;
+    if( nIn>(size_t)(n-i) ) nIn = (size_t)(n-i);
+    nDone = BatchBatch(p, &aMajor[i], &aMinor[i], nIn, pLog);
+    if( nDone<1 || nDone>nIn ) return n;
+    for(j=i; j<i+(int)nDone-1; j++) nBad += aStop[j];
+    if( nDone<nIn && !aStop[i+nDone-1] ) nBad++;
+    i += (int)nDone;
+  }
+  BatchFree(p, free);
+  return nBad;
+}
+
+int main(int argc, char **argv){
+  int nStmt = argc>1 ? atoi(argv[1]) : 200;
+  int nMax = 4*nStmt*12 + 4;
+  int *aMajor = (int*)malloc(sizeof(int)*nMax);
+  int *aMinor = (int*)malloc(sizeof(int)*nMax);
+  char *aStop = (char*)malloc(nMax);
+  struct BatchLog one = {0, 0}, whole = {0, 0}, runs = {0, 0};
+  int n, i, nBad;
+  void *p;
+
+  if( aMajor==0 || aMinor==0 || aStop==0 || nStmt<1 ) return 1;
+  n = makeTokens(aMajor, aMinor, 4, nStmt);
+
+  p = BatchAlloc(malloc);
+  for(i=0; i<n; i++){
+    int nStop = one.nStop;
+    Batch(p, aMajor[i], aMinor[i], &one);
+    aStop[i] = one.nStop>nStop;
+  }
+  BatchFree(p, free);
+
+  nBad = runBatches(aMajor, aMinor, aStop, n, n, &whole);
+  nBad += runBatches(aMajor, aMinor, aStop, n, 0, &runs);
+  printf("%d tokens, %d errors and accepts\n", n, one.nStop);
+  if( one.nStop<=4 ){
+    printf("no syntax errors to test\n");
+    return 1;
+  }
+  if( nBad ){
+    printf("ParseBatch() ended %d times where Parse() did not stop\n", nBad);
+    return 1;
+  }
+  if( whole.h!=one.h || whole.nStop!=one.nStop
+   || runs.h!=one.h || runs.nStop!=one.nStop ){
+    printf("ParseBatch() does not do what Parse() does\n");
+    return 1;
+  }
+  free(aMajor);
+  free(aMinor);
+  free(aStop);
+  return 0;
+}
@@ -0,0 +1,16 @@
+/*
+** ID is shifted both as itself and as a member of the ID|X multi-terminal,
+** to different states.  The default lookahead algorithm reports the
+** shift/shift conflict; -Ldigraph must walk the rules through the right
+** one of the two shifts and give the same tables.
+*/
+%name Dupshift
+%expect 1
+
+top ::= prog.
+prog ::= prog stmt SEMI.
+prog ::= .
+stmt ::= ID|X EQ e.
+stmt ::= e.
+e ::= ID.
+e ::= NUM.
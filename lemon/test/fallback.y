@@ -0,0 +1,34 @@
+/*
+** Keywords that fall back to ID, and a wildcard, for fallback_test.c.
+** Some lookups fall back and then take the wildcard.
+*/
+%name Fallback
+%token_type {int}
+%fallback ID KW1 KW2.
+%wildcard ANY.
+%left PLUS.
+
+prog ::= stmts.
+stmts ::= .
+stmts ::= stmts stmt SEMI.
+stmt ::= ID EQ e.
+stmt ::= KW1 e.
+stmt ::= KW2 LP args RP.
+stmt ::= SKIP anys.
+anys ::= .
+anys ::= anys ANY.
+args ::= .
+args ::= args e COMMA.
+e ::= e PLUS e.
+e ::= ID.
+e ::= NUM.
+
+%code {
+#ifdef YYTRACERING
+/* yyRecordEvent() must be usable as the body of an if with an else */
+void FallbackRecordOutcome(void *p, int bAccept){
+  if( bAccept ) yyRecordEvent((yyParser*)p, YYEV_ACCEPT, 0, 0, 0);
+  else yyRecordEvent((yyParser*)p, YYEV_ERROR, 0, 0, 0);
+}
+#endif
+}
@@ -0,0 +1,105 @@
+/*
+** Parse a script that uses fallbacks and the wildcard, and print the
+** YYSTATS counts and the YYTRACERING events.  run_test.sh builds this
+** with and without -F, which must print the same.  The counts are read
+** both through ParseStats() and through ParseGetStats(), which must agree.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fallback.h"
+
+void *FallbackAlloc(void *(*)(size_t));
+void Fallback(void*, int, int);
+void FallbackFree(void*, void (*)(void*));
+void FallbackStats(void*, FILE*, int);
+
+typedef struct FallbackStatsT FallbackStatsT;
+struct FallbackStatsT {
+  unsigned long nShift;
+  unsigned long nShiftReduce;
+  unsigned long nDefaultReduce;
+  unsigned long nFallback;
+  unsigned long nSyntaxError;
+  unsigned long nRecovery;
+  int nRule;
+  const unsigned long *aRule;
+  int nDepth;
+  const unsigned long *aDepth;
+};
+void FallbackGetStats(void*, FallbackStatsT*);
+int FallbackTraceRingSave(void*, FILE*);
+int FallbackTraceRingDecode(FILE*, FILE*);
+
+static const int aToken[] = {
+  ID, EQ, NUM, SEMI,                  /* no fallback */
+  KW1, NUM, SEMI,                     /* KW1 as itself */
+  ID, EQ, KW2, PLUS, KW1, SEMI,       /* both fall back to ID */
+  SKIP, KW1, ID, NUM, SEMI,           /* wildcard, KW1 after its fallback */
+  KW2, LP, KW1, COMMA, RP, SEMI,      /* KW1 falls back in an argument */
+  0
+};
+
+/* Print the counts the way ParseStats() does, less the rule names */
+static void printStats(const FallbackStatsT *pStats, FILE *out){
+  int i;
+  fprintf(out, "shift %lu\n", pStats->nShift);
+  fprintf(out, "shiftreduce %lu\n", pStats->nShiftReduce);
+  fprintf(out, "default-reduce %lu\n", pStats->nDefaultReduce);
+  fprintf(out, "fallback %lu\n", pStats->nFallback);
+  fprintf(out, "syntax-error %lu\n", pStats->nSyntaxError);
+  fprintf(out, "recovery %lu\n", pStats->nRecovery);
+  for(i=0; i<pStats->nRule; i++){
+    if( pStats->aRule[i] ) fprintf(out, "rule %d %lu\n", i, pStats->aRule[i]);
+  }
+  for(i=0; i<pStats->nDepth; i++){
+    if( pStats->aDepth[i] ){
+      fprintf(out, "depth %d %lu\n", i, pStats->aDepth[i]);
+    }
+  }
+}
+
+/* True if file a has the lines of file b, where a may also have the rule
+** names that ParseStats() adds in builds without NDEBUG */
+static int sameStats(FILE *a, FILE *b){
+  char zA[200], zB[200];
+  rewind(a);
+  rewind(b);
+  while( fgets(zB, sizeof(zB), b) ){
+    int n;
+    if( fgets(zA, sizeof(zA), a)==0 ) return 0;
+    n = (int)strlen(zB) - 1;
+    if( strncmp(zA, zB, n)!=0 || (zA[n]!='\n' && zA[n]!=' ') ) return 0;
+  }
+  return fgets(zA, sizeof(zA), a)==0;
+}
+
+int main(void){
+  void *p = FallbackAlloc(malloc);
+  FILE *ring = tmpfile();
+  FILE *viaStats = tmpfile();
+  FILE *viaGet = tmpfile();
+  FallbackStatsT stats;
+  int i;
+
+  if( p==0 || ring==0 || viaStats==0 || viaGet==0 ) return 1;
+  for(i=0; i<(int)(sizeof(aToken)/sizeof(aToken[0])); i++){
+    Fallback(p, aToken[i], 0);
+  }
+  FallbackStats(p, stdout, 0);
+  FallbackStats(p, viaStats, 0);
+  FallbackGetStats(p, &stats);
+  printStats(&stats, viaGet);
+  if( !sameStats(viaStats, viaGet) ){
+    printf("ParseGetStats() does not agree with ParseStats()\n");
+    return 1;
+  }
+  fclose(viaStats);
+  fclose(viaGet);
+  if( FallbackTraceRingSave(p, ring)<0 ) return 1;
+  rewind(ring);
+  if( FallbackTraceRingDecode(ring, stdout)<0 ) return 1;
+  fclose(ring);
+  FallbackFree(p, free);
+  return 0;
+}
@@ -0,0 +1,14 @@
+/*
+** The %nonassoc resolution of "e ::= e EQ e" leaves both an ERROR and a
+** REDUCE for EQ in a state whose default reduce is another rule.  Coded
+** with -k, that lookahead must still get a single case label.
+*/
+%name Nonassoc
+%nonassoc EQ.
+
+prog ::= LB t RB.
+prog ::= LB t COMMA.
+prog ::= e SEMI.
+t ::= e EQ e.
+e ::= e EQ e.
+e ::= NUM.
@@ -0,0 +1,12 @@
+/*
+** A grammar with no %token_type, so that the minor token values have
+** the default type void*.
+*/
+%name Notype
+
+prog ::= list.
+list ::= list item.
+list ::= item.
+item ::= A.
+item ::= B C.
+item ::= D.
@@ -0,0 +1,177 @@
+#!/bin/sh
+# Build lemon, run it over the grammars in this directory, and compile the
+# generated parsers as C and as C++ with warnings treated as errors.  Then
+# run the test programs against the parsers they go with.
+#
+#	run_test.sh [work-directory]
+#
+# CC and CXX select the compilers.  The work directory, which defaults to
+# a fresh one under /tmp, is left behind when a test fails.
+
+TEST_DIR=`cd "\`dirname "$0"\`" && pwd`
+WORK_DIR=${1:-/tmp/lemon-test.$$}
+CC=${CC:-cc}
+CXX=${CXX:-c++}
+
+errors=0
+
+mkdir -p "$WORK_DIR" || exit 1
+cp "$TEST_DIR"/../lempar.c "$TEST_DIR"/*.y "$TEST_DIR"/*_test.c "$WORK_DIR"/ || exit 1
+cd "$WORK_DIR" || exit 1
+$CC -o lemon "$TEST_DIR"/../lemon.c -pthread || exit 1
+
+# compile_test grammar [lemon-flags...]
+compile_test() {
+	root=$1
+	shift
+	echo "** testing $root.y $*"
+	rm -f "$root.c" "$root.h"
+	if ! ./lemon -q "$@" "$root.y"
+	then
+		echo "...lemon failed on $root.y"
+		errors=1
+		return
+	fi
+	if ! $CC -Werror -c "$root.c" -o "$root.o"
+	then
+		echo "...C compile failed for $root.y $*"
+		errors=1
+	fi
+	if ! $CXX -Werror -x c++ -c "$root.c" -o "$root.o"
+	then
+		echo "...C++ compile failed for $root.y $*"
+		errors=1
+	fi
+}
+
+# c89_test grammar [lemon-flags...]: the parser, with the optional parts
+# that add code to yy_find_shift_action(), must keep declarations first
+c89_test() {
+	root=$1
+	shift
+	echo "** testing $root.y $* as C89"
+	rm -f "$root.c" "$root.h"
+	if ! ./lemon -q "$@" "$root.y" >/dev/null
+	then
+		echo "...lemon failed on $root.y"
+		errors=1
+		return
+	fi
+	if ! $CC -std=c89 -pedantic -Wdeclaration-after-statement -Werror \
+		-DYYTRACERING=64 -DYYSTATS -c "$root.c" -o "$root.o"
+	then
+		echo "...C89 compile failed for $root.y $*"
+		errors=1
+	fi
+}
+
+# digraph_test grammar: -Ldigraph must give the same parser as the default
+digraph_test() {
+	root=$1
+	echo "** comparing $root.y with -Ldigraph"
+	rm -f "$root.c" "$root.h" "$root-default.c"
+	if ! ./lemon -q "$root.y" || ! mv "$root.c" "$root-default.c"
+	then
+		echo "...lemon failed on $root.y"
+		errors=1
+		return
+	fi
+	if ! ./lemon -q -Ldigraph "$root.y"
+	then
+		echo "...lemon -Ldigraph failed on $root.y"
+		errors=1
+	elif ! cmp -s "$root-default.c" "$root.c"
+	then
+		echo "...lemon -Ldigraph gives different tables for $root.y"
+		errors=1
+	fi
+}
+
+# resolved_test grammar [lemon-flags...]: with YYSTATS and YYTRACERING,
+# the test program must print the same for tables built with -F
+resolved_test() {
+	root=$1
+	shift
+	echo "** comparing ${root}_test output with $root.y $* and with -F"
+	for f in plain resolved
+	do
+		if test $f = plain
+		then
+			./lemon -q "$@" "$root.y" >/dev/null
+		else
+			./lemon -q -F "$@" "$root.y" >/dev/null
+		fi
+		if test $? != 0
+		then
+			echo "...lemon failed on $root.y"
+			errors=1
+			return
+		fi
+		if ! $CC -Werror -DYYSTATS -DYYTRACERING=256 -o "${root}_test" \
+			"$root.c" "${root}_test.c"
+		then
+			echo "...compile failed for ${root}_test"
+			errors=1
+			return
+		fi
+		./"${root}_test" >"$root-$f.out"
+	done
+	if ! cmp -s "$root-plain.out" "$root-resolved.out"
+	then
+		echo "...${root}_test prints differently with -F"
+		errors=1
+	fi
+}
+
+# run_test grammar program-arguments [lemon-flags...]
+run_test() {
+	root=$1
+	args=$2
+	shift
+	shift
+	echo "** running ${root}_test $args with $root.y $*"
+	rm -f "$root.c" "$root.h"
+	if ! ./lemon -q "$@" "$root.y"
+	then
+		echo "...lemon failed on $root.y"
+		errors=1
+		return
+	fi
+	if ! $CC -Werror -o "${root}_test" "$root.c" "${root}_test.c"
+	then
+		echo "...compile failed for ${root}_test"
+		errors=1
+	elif ! ./"${root}_test" $args
+	then
+		echo "...${root}_test failed"
+		errors=1
+	fi
+}
+
+compile_test notype
+compile_test notype -k
+compile_test nonassoc
+compile_test nonassoc -k
+compile_test dupshift -Ldigraph
+digraph_test dupshift
+digraph_test nonassoc
+compile_test fallback -F
+c89_test fallback
+c89_test fallback -k
+c89_test fallback -F
+resolved_test fallback
+resolved_test fallback -k
+run_test batch 200
+run_test batch 200 -k
+run_test snapshot "2000 20"
+run_test snapshot "2000 20" -V
+run_test aligned 100
+run_test aligned 100 -V
+
+if test $errors = 0
+then
+	echo "...ok"
+	cd /
+	rm -rf "$WORK_DIR"
+fi
+exit $errors
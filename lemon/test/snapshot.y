@@ -0,0 +1,39 @@
+/*
+** A script of statements for snapshot_test.c.  Every expression value is
+** heap-allocated, so the %destructors and the ParseSnapshot() copy hook
+** have real work to do, and a value that is freed twice or leaked shows
+** up under a memory checker.  The result folds every statement value
+** into one number, so a reparse that goes wrong gives a different one.
+*/
+%name Snap
+%include {
+#include <stdlib.h>
+#include <assert.h>
+int *SnapBox(int v){
+  int *p = (int*)malloc(sizeof(int));
+  if( p==0 ) abort();
+  *p = v;
+  return p;
+}
+}
+%token_type {int}
+%extra_argument {long *pResult}
+%type e {int*}
+%type stmts {int*}
+%destructor e { free($$); }
+%destructor stmts { free($$); }
+%syntax_error { *pResult = -1; }
+%left PLUS.
+%left TIMES.
+
+prog ::= stmts(S). { *pResult = *S; free(S); }
+stmts(A) ::= . { A = SnapBox(0); }
+stmts(A) ::= stmts(B) e(C) SEMI. {
+  A = SnapBox((*B*31 + *C) % 1000003);
+  free(B);
+  free(C);
+}
+e(A) ::= e(B) PLUS e(C). { A = SnapBox((*B + *C) % 1000); free(B); free(C); }
+e(A) ::= e(B) TIMES e(C). { A = SnapBox(*B * *C % 1000); free(B); free(C); }
+e(A) ::= LP e(B) RP. { A = B; }
+e(A) ::= NUM(B). { A = SnapBox(B); }
@@ -0,0 +1,149 @@
+/*
+** Incremental reparsing with ParseSnapshot() and ParseRestore(), the way
+** an editor would use them, checked against and timed against reparsing
+** the whole script.
+**
+**	snapshot_test [statements [edits]]
+**
+** A script of random statements is parsed once, taking a snapshot at
+** every statement boundary.  Then each edit changes one number in the
+** script, and the script is parsed again twice: once from the start,
+** and once from the last snapshot before the edit, taking new snapshots
+** for the statements after it.  Both must give the same result.  The
+** program prints the time each way took and exits non-zero on a mismatch.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "snapshot.h"
+
+void *SnapAlloc(void *(*)(size_t));
+void Snap(void*, int, int, long*);
+void SnapReset(void*);
+void SnapFree(void*, void (*)(void*));
+void *SnapSnapshot(void*, void *(*)(size_t), void (*)(void*,int,void*), void*);
+int SnapRestore(void*, const void*);
+void SnapSnapshotFree(void*, void*, void (*)(void*));
+int *SnapBox(int);
+
+/* Values of the nonterminals own a heap block; give a copy its own */
+static void copyValue(void *pArg, int major, void *pValue){
+  int **pp = (int**)pValue;
+  (void)pArg;
+  if( major!=NUM && major!=SEMI && major!=PLUS && major!=TIMES
+   && major!=LP && major!=RP && major!=0 ){
+    *pp = SnapBox(**pp);
+  }
+}
+
+static unsigned long long seed = 1;
+static int rnd(int n){
+  seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+  return (int)((seed>>33) % (unsigned)n);
+}
+
+/* Write a script of nStmt statements into aMajor[]/aMinor[] and return
+** the number of tokens */
+static int makeScript(int *aMajor, int *aMinor, int nStmt){
+  int n = 0, i, j, k;
+  for(i=0; i<nStmt; i++){
+    aMajor[n] = NUM; aMinor[n++] = rnd(100);
+    for(j=0, k=1+rnd(20); j<k; j++){
+      aMajor[n] = rnd(2) ? PLUS : TIMES; aMinor[n++] = 0;
+      if( rnd(4)==0 ){
+        aMajor[n] = LP; aMinor[n++] = 0;
+        aMajor[n] = NUM; aMinor[n++] = rnd(100);
+        aMajor[n] = RP; aMinor[n++] = 0;
+      }else{
+        aMajor[n] = NUM; aMinor[n++] = rnd(100);
+      }
+    }
+    aMajor[n] = SEMI; aMinor[n++] = 0;
+  }
+  return n;
+}
+
+int main(int argc, char **argv){
+  int nStmt = argc>1 ? atoi(argv[1]) : 20000;
+  int nEdit = argc>2 ? atoi(argv[2]) : 50;
+  int *aMajor = (int*)malloc(sizeof(int)*(nStmt*80+1));
+  int *aMinor = (int*)malloc(sizeof(int)*(nStmt*80+1));
+  void **aSnap = (void**)malloc(sizeof(void*)*(nStmt+1));
+  int *aPos = (int*)malloc(sizeof(int)*(nStmt+1));
+  long resFull = 0, resInc = 0;
+  clock_t tFull = 0, tInc = 0, t0;
+  int nToken, nSnap, i, e, s, pos;
+  long nReparsed = 0;
+  void *p;
+
+  if( aMajor==0 || aMinor==0 || aSnap==0 || aPos==0 || nStmt<1 ) return 1;
+  nToken = makeScript(aMajor, aMinor, nStmt);
+  p = SnapAlloc(malloc);
+
+  /* The first parse, with a snapshot before every statement.  aSnap[s] is
+  ** the state of the parser just before token aPos[s]. */
+  nSnap = 0;
+  aPos[nSnap] = 0;
+  aSnap[nSnap++] = SnapSnapshot(p, malloc, copyValue, 0);
+  for(i=0; i<nToken; i++){
+    Snap(p, aMajor[i], aMinor[i], &resInc);
+    if( aMajor[i]==SEMI && i+1<nToken ){
+      aPos[nSnap] = i+1;
+      aSnap[nSnap++] = SnapSnapshot(p, malloc, copyValue, 0);
+    }
+  }
+  Snap(p, 0, 0, &resInc);
+
+  for(e=0; e<nEdit; e++){
+    do{ pos = rnd(nToken); }while( aMajor[pos]!=NUM );
+    aMinor[pos] = rnd(100);
+
+    t0 = clock();
+    SnapReset(p);
+    for(i=0; i<nToken; i++) Snap(p, aMajor[i], aMinor[i], &resFull);
+    Snap(p, 0, 0, &resFull);
+    tFull += clock() - t0;
+
+    t0 = clock();
+    for(s=0; s+1<nSnap && aPos[s+1]<=pos; s++){}
+    nReparsed += nToken - aPos[s];
+    if( SnapRestore(p, aSnap[s]) ){
+      printf("ParseRestore() failed\n");
+      return 1;
+    }
+    for(i=aPos[s]; i<nToken; i++){
+      Snap(p, aMajor[i], aMinor[i], &resInc);
+      if( aMajor[i]==SEMI && i+1<nToken ){
+        s++;
+        SnapSnapshotFree(p, aSnap[s], free);
+        aSnap[s] = SnapSnapshot(p, malloc, copyValue, 0);
+      }
+    }
+    Snap(p, 0, 0, &resInc);
+    tInc += clock() - t0;
+
+    if( resFull!=resInc ){
+      printf("edit %d: full reparse gives %ld, incremental gives %ld\n",
+             e, resFull, resInc);
+      return 1;
+    }
+  }
+
+  printf("%d statements, %d tokens, %d edits\n", nStmt, nToken, nEdit);
+  if( nEdit>0 ){
+    printf("full reparse:        %.3fs\n", (double)tFull/CLOCKS_PER_SEC);
+    printf("from last snapshot:  %.3fs, %.0f%% of the tokens",
+           (double)tInc/CLOCKS_PER_SEC,
+           100.0*(double)nReparsed/((double)nToken*nEdit));
+    if( tInc>0 ) printf(", %.2fx faster", (double)tFull/(double)tInc);
+    printf("\n");
+  }
+
+  for(i=0; i<nSnap; i++) SnapSnapshotFree(p, aSnap[i], free);
+  SnapFree(p, free);
+  free(aMajor);
+  free(aMinor);
+  free(aSnap);
+  free(aPos);
+  return 0;
+}